@@ -0,0 +1,111 @@
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ShaderLibrary.h"
+#include "SampleBatch.h"
+#include "TileStatistics.h"
+
+// Adaptive sampling over screen tiles. Every INTERVAL frames TileStatistics sums
+// the expected squared error of each tile's pixels, and until the next estimate
+// every tile gets samples in proportion to its error per pixel, on top of FLOOR
+// of the uniform rate so a tile whose first samples happened to agree is not
+// starved. The rates average to the uniform one, so a frame costs about as many
+// paths as a uniform pass of the same samples per pixel; fractional counts are
+// carried over to later frames. Tiles end up with different counts, which the
+// view pass reads from the accumulation's alpha.
+class AdaptiveSampler {
+public:
+	static const unsigned int INTERVAL = 8;			//frames between error estimates
+	static constexpr double FLOOR = 0.25;			//share of the uniform rate every tile keeps
+
+	using Tile = TileStatistics::Tile;
+
+	AdaptiveSampler(unsigned int width, unsigned int height, unsigned int tileSize, ShaderLibrary& library) :
+		width(width),
+		height(height),
+		statistics(width, height, tileSize, library),
+		rates(statistics.tileCount(), 1.0),
+		carry(statistics.tileCount(), 0.0),
+		counts(statistics.tileCount(), 0)
+	{
+	}
+
+	// blocks until the error program is built, so the first estimate does not have to
+	void waitUntilReady() {
+		statistics.waitUntilReady();
+	}
+
+	unsigned int size() const {
+		return statistics.size();
+	}
+
+	unsigned int tileCount() const {
+		return statistics.tileCount();
+	}
+
+	Tile tile(unsigned int index) const {
+		return statistics.tile(index);
+	}
+
+	// the accumulation was dropped (camera move); every tile is sampled uniformly
+	// until the next estimate
+	void reset() {
+		std::fill(rates.begin(), rates.end(), 1.0);
+		std::fill(carry.begin(), carry.end(), 0.0);
+		frames = 0;
+	}
+
+	// Samples per pixel of every tile for the next frame, for an average of samples
+	// over the image. A tile can get 0 in a frame while its share is below one sample.
+	const std::vector<unsigned int>& allocate(unsigned int samples) {
+		for (size_t i = 0; i < rates.size(); i++) {
+			double exact = samples * (FLOOR + (1.0 - FLOOR) * rates[i]) + carry[i];
+			counts[i] = (unsigned int)std::min(std::floor(exact), (double)SampleBatch::MAX_SAMPLES);
+			carry[i] = std::min(exact - counts[i], 1.0);
+		}
+		return counts;
+	}
+
+	// Called after every frame traced with allocate()'s counts; every INTERVAL
+	// frames it reads the error of each tile back from the given accumulation and
+	// squared luminance textures and sets the rates of the next frames. The read
+	// back waits for the GPU, but only moves one float per tile.
+	void frameTraced(GLuint accumulation, GLuint squares) {
+		if (++frames % INTERVAL != 0) {
+			return;
+		}
+		const std::vector<TileStatistics::Sums>& sums = statistics.read(accumulation, squares);
+
+		//error per pixel of every tile relative to that of the whole image
+		double total = 0.0;
+		for (const TileStatistics::Sums& tile : sums) {
+			total += tile.error;
+		}
+		if (!(total > 0.0)) {
+			std::fill(rates.begin(), rates.end(), 1.0);
+			return;
+		}
+		double meanError = total / ((double)width * height);
+		for (unsigned int i = 0; i < tileCount(); i++) {
+			Tile t = tile(i);
+			rates[i] = sums[i].error / ((double)(t.x1 - t.x0) * (t.y1 - t.y0)) / meanError;
+		}
+	}
+
+private:
+	unsigned int width;
+	unsigned int height;
+	TileStatistics statistics;
+	std::vector<double> rates;					//samples per pixel relative to the uniform rate
+	std::vector<double> carry;					//fraction of a sample owed to each tile
+	std::vector<unsigned int> counts;			//of the latest allocate()
+	unsigned int frames = 0;
+};
+
+#endif
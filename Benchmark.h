@@ -0,0 +1,194 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "CpuPathTracing.h"
+#include "SimdIntersect.h"
+
+// keeps benchmark loops from being optimized away
+inline volatile float benchmarkSink;
+
+// Rays that look like the tracer's workload: jittered primary rays through the
+// image and diffuse bounce rays leaving their first hit.
+inline std::vector<Ray> makeBenchmarkRays(const Scene& scene, const glm::mat4& view, unsigned int width, unsigned int height, float fov) {
+	PrimaryRayParams params(view, width, height, fov);
+	std::vector<Ray> rays;
+	rays.reserve((size_t)width * height * 2);
+	glm::vec2 randomVector(0.37f, 0.21f);
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			ShaderRandom random = { glm::vec2(x + 0.5f, y + 0.5f), randomVector };
+			Ray ray = generatePrimaryRay(params, params.pixelPos(x + 0.5f, y + 0.5f), random);
+			rays.push_back(ray);
+			HitInfo hit;
+			Ray scatter;
+			if (intersectRay(scene, ray, hit) && computeScatterRay(hit, ray, random, scatter)) {
+				rays.push_back(scatter);
+			}
+		}
+	}
+	return rays;
+}
+
+// Shadow rays of the tracer's light sampling from the first hit of every ray: one
+// toward each light, ending at it, and one in a cosine distributed direction that
+// never ends (a sky visibility query). maxT holds where each one ends.
+inline std::vector<ShadowRay> makeBenchmarkShadowRays(const Scene& scene, const std::vector<Ray>& rays) {
+	std::vector<ShadowRay> shadows;
+	glm::vec2 randomVector(0.37f, 0.21f);
+	for (size_t i = 0; i < rays.size(); i++) {
+		HitInfo hit;
+		if (!intersectRay(scene, rays[i], hit)) {
+			continue;
+		}
+		lightSamples(scene.lights, hit, [&](const ShadowRay& shadow) {
+			shadows.push_back(shadow);
+		});
+		ShaderRandom random = { glm::vec2((float)i, 0.5f), randomVector };
+		shadows.push_back({ { hit.position + 1e-3f * hit.normal, cosineDirection(hit.normal, random) }, 1e30f, glm::vec3(1.0f) });
+	}
+	return shadows;
+}
+
+// small diffuse spheres scattered over the ground
+inline void addBenchmarkSpheres(Scene& scene, unsigned int extraSpheres) {
+	std::mt19937 generator(1234u);
+	std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> radius(0.1f, 0.6f);
+	for (unsigned int i = 0; i < extraSpheres; i++) {
+		float r = radius(generator);
+		scene.spheres.push_back(Sphere(glm::vec3(position(generator), -2.0f + r, position(generator)), r,
+			Material(true, false, glm::vec3(0.8f, 0.8f, 0.8f))));
+	}
+}
+
+// the default scene plus extra small spheres scattered over the ground
+inline Scene makeBenchmarkScene(unsigned int extraSpheres) {
+	Scene scene = Scene::createDefault();
+	addBenchmarkSpheres(scene, extraSpheres);
+	return scene;
+}
+
+// Times closest hit queries with the scalar reference loop and every SIMD kernel
+// the CPU supports, and checks that the kernels agree with the reference. Then
+// times shadow rays answered by a closest hit against the any hit kernels.
+inline void benchmarkIntersection(const glm::mat4& view, float fov) {
+	const unsigned int sceneSizes[] = { 0, 52, 500 };
+	const unsigned int repetitions = 5;
+	SimdLevel available = detectSimdLevel();
+	std::cout << "closest hit benchmark, best SIMD level: " << simdLevelName(available) << std::endl;
+
+	for (unsigned int extra : sceneSizes) {
+		Scene scene = makeBenchmarkScene(extra);
+		std::vector<Ray> rays = makeBenchmarkRays(scene, view, 320, 180, fov);
+		std::vector<ClosestHit> reference(rays.size());
+		std::cout << scene.spheres.size() + scene.planes.size() << " primitives, " << rays.size() << " rays" << std::endl;
+
+		auto measure = [&](const char* name, bool check, auto&& query) {
+			unsigned int mismatches = 0;
+			double best = 1e30;
+			for (unsigned int r = 0; r < repetitions; r++) {
+				auto start = std::chrono::steady_clock::now();
+				for (size_t i = 0; i < rays.size(); i++) {
+					ClosestHit hit = query(rays[i]);
+					benchmarkSink = hit.t;
+					if (check && r == 0 && hit.primitive != reference[i].primitive) {
+						mismatches++;
+					}
+				}
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				best = std::min(best, seconds);
+			}
+			std::cout << "  " << std::setw(16) << std::left << name << std::setw(10) << std::right << std::fixed << std::setprecision(2)
+				<< rays.size() / best / 1e6 << " Mrays/sec";
+			if (mismatches > 0) {
+				std::cout << "  (" << mismatches << " results differ from the reference loop)";
+			}
+			std::cout << std::endl;
+		};
+
+		//reference: the per-primitive loop of IntersectRay
+		for (size_t i = 0; i < rays.size(); i++) {
+			HitInfo hit;
+			if (intersectRay(scene, rays[i], hit)) {
+				reference[i].t = hit.t;
+				for (size_t s = 0; s < scene.spheres.size(); s++) {
+					if (hit.mtl == &scene.spheres[s].mtl) {
+						reference[i].primitive = (int)s;
+					}
+				}
+				for (size_t p = 0; p < scene.planes.size(); p++) {
+					if (hit.mtl == &scene.planes[p].mtl) {
+						reference[i].primitive = (int)(scene.spheres.size() + p);
+					}
+				}
+			}
+		}
+		measure("scalar loop", false, [&](const Ray& ray) {
+			HitInfo hit;
+			ClosestHit result;
+			if (intersectRay(scene, ray, hit)) {
+				result.t = hit.t;
+			}
+			return result;
+		});
+		for (int level = (int)SimdLevel::Scalar; level <= (int)available; level++) {
+			SimdIntersector intersector(scene, (SimdLevel)level);
+			std::string name = std::string("soa ") + simdLevelName((SimdLevel)level);
+			measure(name.c_str(), true, [&](const Ray& ray) {
+				return intersector.closestHit(ray);
+			});
+		}
+
+		std::vector<ShadowRay> shadows = makeBenchmarkShadowRays(scene, rays);
+		std::vector<char> blocked(shadows.size());
+		size_t blockedCount = 0;
+		for (size_t i = 0; i < shadows.size(); i++) {
+			blocked[i] = occludedRay(scene, shadows[i].ray, shadows[i].maxT);
+			blockedCount += blocked[i];
+		}
+		std::cout << shadows.size() << " shadow rays, " << std::setprecision(1) << 100.0 * blockedCount / shadows.size() << "% blocked" << std::endl;
+		auto measureShadows = [&](const std::string& name, auto&& query) {
+			unsigned int mismatches = 0;
+			double best = 1e30;
+			for (unsigned int r = 0; r < repetitions; r++) {
+				auto start = std::chrono::steady_clock::now();
+				for (size_t i = 0; i < shadows.size(); i++) {
+					bool hit = query(shadows[i]);
+					benchmarkSink = hit ? 1.0f : 0.0f;
+					if (r == 0 && hit != (bool)blocked[i]) {
+						mismatches++;
+					}
+				}
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				best = std::min(best, seconds);
+			}
+			std::cout << "  " << std::setw(16) << std::left << name << std::setw(10) << std::right << std::fixed << std::setprecision(2)
+				<< shadows.size() / best / 1e6 << " Mrays/sec";
+			if (mismatches > 0) {
+				std::cout << "  (" << mismatches << " results differ from the reference loop)";
+			}
+			std::cout << std::endl;
+		};
+		for (int level = (int)SimdLevel::Scalar; level <= (int)available; level++) {
+			SimdIntersector intersector(scene, (SimdLevel)level);
+			measureShadows(std::string("closest ") + simdLevelName((SimdLevel)level), [&](const ShadowRay& shadow) {
+				return intersector.closestHit(shadow.ray).t < shadow.maxT;
+			});
+			measureShadows(std::string("any hit ") + simdLevelName((SimdLevel)level), [&](const ShadowRay& shadow) {
+				return intersector.occluded(shadow.ray, shadow.maxT);
+			});
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,19 @@
+#version 450 core
+// Marks the converged pixels in the stencil buffer: the pass is drawn with the
+// stencil op set to replace, and discards the fragments of every other pixel.
+// The framebuffer has only the stencil attachment, so reading the accumulation
+// here is not a feedback loop.
+
+#include "Statistics.glsl"
+
+uniform sampler2D accumulation;
+uniform sampler2D luminanceSquares;
+uniform float threshold;
+uniform uint minSamples;
+
+void main(){
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	if(!PixelConverged(texelFetch(accumulation, pixel, 0), texelFetch(luminanceSquares, pixel, 0).r, threshold, minSamples)){
+		discard;
+	}
+}
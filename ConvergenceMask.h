@@ -0,0 +1,206 @@
+#ifndef CONVERGENCE_MASK_H
+#define CONVERGENCE_MASK_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "FrameUniforms.h"
+#include "ShaderLibrary.h"
+
+// Which pixels no longer need samples, rebuilt every INTERVAL passes from the
+// statistics the tracers accumulate (Statistics.glsl). Converged pixels keep the
+// samples they have, so the tracer's time goes to the noisy ones.
+// Fragment tracer  Convergence.fs sets the stencil value of converged pixels to 1
+//                  and the tracer draws with the stencil test, so the early
+//                  stencil test rejects them before the fragment shader runs
+// Compute tracer   Convergence.comp lists the pixels that are not converged, and
+//                  the tracer runs one invocation per listed pixel with an
+//                  indirect dispatch
+class ConvergenceMask {
+public:
+	static const unsigned int INTERVAL = 8;			//tracer passes between rebuilds
+	static const unsigned int MIN_SAMPLES = 16;		//before a pixel may count as converged
+
+	// threshold is the relative standard error of a pixel's mean luminance below
+	// which it is converged. accumulation and squares are the tracer's textures,
+	// frameBuffer the one the fragment tracer draws into (its stencil is added here).
+	ConvergenceMask(bool fragment, unsigned int width, unsigned int height, float threshold, unsigned int tracerGroup,
+		GLuint frameBuffer, GLuint accumulation, GLuint squares, const FrameUniforms& frame, ShaderLibrary& library) :
+		fragment(fragment),
+		width(width),
+		height(height),
+		threshold(threshold),
+		accumulation(accumulation),
+		squares(squares),
+		frame(frame)
+	{
+		GLint originalFrameBuffer;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &originalFrameBuffer);
+		if (fragment) {
+			maskShader = library.program("VertexShader.vs", "Convergence.fs", "");
+			glGenRenderbuffers(1, &stencil);
+			glBindRenderbuffer(GL_RENDERBUFFER, stencil);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8, width, height);
+			glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencil);
+			//the mask pass reads the accumulation, so it draws into a framebuffer without it
+			glGenFramebuffers(1, &maskFrameBuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, maskFrameBuffer);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencil);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+			complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		}
+		else {
+			maskShader = library.compute("Convergence.comp", "#define STAGE_LIST\n");
+			argsShader = library.compute("Convergence.comp", "#define STAGE_ARGS\n#define TRACER_GROUP " + std::to_string(tracerGroup) + "\n");
+			//dispatchSize (uvec3), activeCount, activePixels[]
+			glGenBuffers(1, &pixelListBuffer);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, pixelListBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) + (size_t)width * height * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			complete = true;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, originalFrameBuffer);
+		reset();
+	}
+
+	~ConvergenceMask() {
+		glDeleteFramebuffers(1, &maskFrameBuffer);
+		glDeleteRenderbuffers(1, &stencil);
+		glDeleteBuffers(1, &pixelListBuffer);
+	}
+
+	ConvergenceMask(const ConvergenceMask&) = delete;
+	ConvergenceMask& operator=(const ConvergenceMask&) = delete;
+
+	bool isComplete() const {
+		return complete;
+	}
+
+	// true once the mask programs are built; sets their uniforms the first time
+	bool isReady(const glm::mat4& projection) {
+		if (configured) {
+			return true;
+		}
+		if (!maskShader->isReady() || (argsShader && !argsShader->isReady())) {
+			return false;
+		}
+		maskShader->use();
+		maskShader->setFloat("threshold", threshold);
+		maskShader->setUInt("minSamples", MIN_SAMPLES);
+		if (fragment) {
+			maskShader->setMat4("proj", projection);
+			maskShader->setInt("accumulation", 0);
+			maskShader->setInt("luminanceSquares", 1);
+			frame.attach(*maskShader);
+		}
+		else {
+			maskShader->setUInt("width", width);
+			maskShader->setUInt("height", height);
+		}
+		configured = true;
+		return true;
+	}
+
+	// the programs were swapped for rebuilt ones; isReady sets their uniforms again
+	void programsReloaded() {
+		configured = false;
+	}
+
+	// the accumulation was dropped: every pixel is traced again until the next rebuild
+	void reset() {
+		valid = false;
+		passes = 0;
+		if (fragment) {
+			GLint originalFrameBuffer;
+			glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &originalFrameBuffer);
+			const GLint zero = 0;
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, maskFrameBuffer);
+			glClearBufferiv(GL_STENCIL, 0, &zero);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, originalFrameBuffer);
+		}
+	}
+
+	// Called before every tracer pass; rebuilds the mask every INTERVAL passes.
+	// quad is the vertex array of the image quad. Needs isReady().
+	void beforePass(GLuint quad) {
+		if (++passes < INTERVAL) {
+			return;
+		}
+		passes = 0;
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, squares);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, accumulation);
+		maskShader->use();
+		if (fragment) {
+			//converged pixels stay converged, so the stencil only ever gains ones
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, maskFrameBuffer);
+			glViewport(0, 0, width, height);
+			glEnable(GL_STENCIL_TEST);
+			glStencilFunc(GL_ALWAYS, 1, 0xFF);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+			glBindVertexArray(quad);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			glDisable(GL_STENCIL_TEST);
+		}
+		else {
+			const GLuint zero = 0;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, pixelListBuffer);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(GLuint), sizeof(zero), &zero);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pixelListBuffer);
+			glBindImageTexture(0, accumulation, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+			glBindImageTexture(1, squares, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			argsShader->use();
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		}
+		valid = true;
+	}
+
+	// false until the first rebuild after a reset; until then every pixel is traced
+	bool isValid() const {
+		return valid;
+	}
+
+	// Fragment tracer: draws that follow only reach pixels that are not converged
+	void enableStencilTest() const {
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_EQUAL, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	}
+
+	// Compute tracer: the list buffer, at binding 0 of PathTracer.comp with PIXEL_LIST
+	// and its own indirect dispatch arguments at offset 0
+	GLuint pixelList() const {
+		return pixelListBuffer;
+	}
+
+private:
+	bool fragment;
+	unsigned int width;
+	unsigned int height;
+	float threshold;
+	GLuint accumulation;
+	GLuint squares;
+	const FrameUniforms& frame;
+	std::shared_ptr<Shader> maskShader;
+	std::shared_ptr<Shader> argsShader;			//compute only
+	GLuint stencil = 0;							//fragment only
+	GLuint maskFrameBuffer = 0;
+	GLuint pixelListBuffer = 0;					//compute only
+	unsigned int passes = 0;
+	bool valid = false;
+	bool configured = false;
+	bool complete = false;
+};
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef CPU_PATH_TRACING_H
+#define CPU_PATH_TRACING_H
+
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+
+// C++ versions of the routines in PathTracing.glsl. They are kept line for line
+// equivalent to the GLSL so the CPU image can be used as a reference for the shader.
+
+#define CPU_MAX_BOUNCE 50
+#define CPU_PI 3.14159265358979323f
+
+struct Ray {
+	glm::vec3 pos;
+	glm::vec3 dir;
+};
+
+struct HitInfo {
+	float t;
+	glm::vec3 position;
+	glm::vec3 normal;
+	const Material* mtl;
+	bool frontFace;
+};
+
+// per pixel generator equivalent to rand() in the shader: seeded with gl_FragCoord.xy
+// and advanced by the per frame randomVector
+struct ShaderRandom {
+	glm::vec2 seed;
+	glm::vec2 randomVector;
+
+	float next() {
+		seed -= randomVector;
+		float v = std::sin(glm::dot(seed, glm::vec2(12.9898f, 78.233f))) * 43758.5453f;
+		return v - std::floor(v);
+	}
+};
+
+// camera quantities the vertex shader and the tracer uniforms provide on the GPU
+struct PrimaryRayParams {
+	glm::mat4 c2w;
+	glm::vec3 cameraPos;
+	glm::vec2 ndcToView;		//camera space extent of the visible image plane at z = -1
+	float viewPixelWidth;
+	float viewPixelHeight;
+	unsigned int width;
+	unsigned int height;
+
+	PrimaryRayParams(const glm::mat4& view, unsigned int width, unsigned int height, float fov) :
+		width(width),
+		height(height)
+	{
+		float aspectRatio = (float)width / (float)height;
+		float ff = std::tan(glm::radians(fov * 0.5f));
+		//the quad spans [-aspect*ff, aspect*ff] but proj uses fov/2, so only its middle is on screen
+		float tanHalf = std::tan(glm::radians(fov * 0.5f) * 0.5f);
+		c2w = glm::inverse(view);
+		cameraPos = glm::vec3(c2w * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		ndcToView = glm::vec2(aspectRatio * tanHalf, tanHalf);
+		viewPixelWidth = 2.0f * aspectRatio * ff / width;
+		viewPixelHeight = 2.0f * ff / height;
+	}
+
+	// pixelPos the vertex shader interpolates for the fragment at the center of (x, y)
+	glm::vec3 pixelPos(float fragX, float fragY) const {
+		float ndcX = 2.0f * fragX / width - 1.0f;
+		float ndcY = 2.0f * fragY / height - 1.0f;
+		return glm::vec3(c2w * glm::vec4(ndcX * ndcToView.x, ndcY * ndcToView.y, -1.0f, 1.0f));
+	}
+};
+
+inline Ray generatePrimaryRay(const PrimaryRayParams& params, const glm::vec3& pixelPos, ShaderRandom& random) {
+	float n = random.next();
+	float offsetX = params.viewPixelWidth * (n - 1) + 0.5f * params.viewPixelWidth;
+	n = random.next();
+	float offsetY = params.viewPixelHeight * (n - 1) + 0.5f * params.viewPixelHeight;
+
+	Ray ray;
+	ray.pos = pixelPos + glm::vec3(offsetX, offsetY, 0.0f);
+	ray.dir = glm::normalize(ray.pos - params.cameraPos);
+	return ray;
+}
+
+inline bool intersectSphere(const Sphere& sphere, const Ray& ray, HitInfo& hit) {
+	glm::vec3 tmp = ray.pos - sphere.center;
+	float a = glm::dot(ray.dir, ray.dir);
+	float b = 2 * glm::dot(ray.dir, tmp);
+	float c = glm::dot(tmp, tmp) - sphere.radius * sphere.radius;
+	float delta = b * b - 4 * a * c;
+	if (delta < 0.0f) {
+		return false;
+	}
+	float t;
+	if (glm::length(tmp) < sphere.radius) {							//ray origin is inside the sphere
+		t = (-b + std::sqrt(delta)) / 2.0f * a;
+	}
+	else {
+		t = (-b - std::sqrt(delta)) / 2.0f * a;
+	}
+	if (t < hit.t && t > 0.0f) {
+		hit.t = t;
+		hit.position = ray.pos + t * ray.dir;
+		hit.normal = glm::normalize(hit.position - sphere.center);
+		hit.frontFace = glm::dot(ray.dir, hit.normal) < 0.0f;
+		hit.normal = hit.frontFace ? hit.normal : -hit.normal;
+		hit.mtl = &sphere.mtl;
+		return true;
+	}
+	return false;
+}
+
+inline bool intersectPlane(const Plane& plane, const Ray& ray, HitInfo& hit) {
+	float denominator = glm::dot(ray.dir, plane.normal);
+	if (denominator == 0.0f) {										//plane and ray are perpendicular
+		return false;
+	}
+	float c = glm::dot(plane.normal, plane.position);
+	float t = (c - glm::dot(ray.pos, plane.normal)) / denominator;
+	glm::vec3 positionOnPlane = ray.pos + t * ray.dir;
+	glm::vec3 distance = positionOnPlane - plane.position;
+	if (std::abs(distance.x) < plane.lenght && std::abs(distance.y) < plane.lenght && std::abs(distance.z) < plane.lenght) {
+		if (t < hit.t && t > 0.0f) {
+			hit.t = t;
+			hit.position = positionOnPlane;
+			hit.normal = plane.normal;
+			hit.frontFace = glm::dot(ray.dir, plane.normal) < 0.0f;
+			hit.normal = hit.frontFace ? hit.normal : -hit.normal;
+			hit.mtl = &plane.mtl;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool intersectRay(const Scene& scene, const Ray& ray, HitInfo& hit) {
+	hit.t = 1e30f;
+	bool foundHit = false;
+	for (const Sphere& sphere : scene.spheres) {
+		foundHit |= intersectSphere(sphere, ray, hit);
+	}
+	for (const Plane& plane : scene.planes) {
+		foundHit |= intersectPlane(plane, ray, hit);
+	}
+	return foundHit;
+}
+
+// Occluded in the shader on top of the reference intersection loop, in scene order:
+// whether anything lies on the ray closer than tMax. The tracers use
+// SimdIntersector::occluded; this is what the benchmark checks it against.
+inline bool occludedRay(const Scene& scene, const Ray& ray, float tMax) {
+	HitInfo hit;
+	for (const Plane& plane : scene.planes) {
+		hit.t = tMax;
+		if (intersectPlane(plane, ray, hit)) {
+			return true;
+		}
+	}
+	for (const Sphere& sphere : scene.spheres) {
+		hit.t = tMax;
+		if (intersectSphere(sphere, ray, hit)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// direction around normal with a pdf of cos/PI, the Lambertian lobe
+inline glm::vec3 cosineDirection(const glm::vec3& normal, ShaderRandom& random) {
+	float phi = 2 * CPU_PI * random.next();
+	float r2 = random.next();
+	glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.5f ? glm::cross(normal, glm::vec3(0, 1, 0)) : glm::cross(normal, glm::vec3(1, 0, 0)));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+	return glm::normalize(std::sqrt(r2) * (std::cos(phi) * tangent + std::sin(phi) * bitangent) + std::sqrt(1.0f - r2) * normal);
+}
+
+// returns false when the material is not defined (errorRay in the shader);
+// cosine = true is the diffuse scatter of the shader built with NEXT_EVENT
+inline bool computeScatterRay(const HitInfo& hit, const Ray& incidentRay, ShaderRandom& random, Ray& scatter, bool cosine = false) {
+	scatter.pos = hit.position + 1e-3f * hit.normal;
+
+	if (hit.mtl->diffuse && cosine) {
+		scatter.dir = cosineDirection(hit.normal, random);
+		return true;
+	}
+	else if (hit.mtl->diffuse) {
+		float y = random.next() * 2.0f - 1.0f;
+		float phi = 2 * CPU_PI * random.next();
+		float x = std::sqrt(1 - y * y) * std::cos(phi);
+		float z = std::sqrt(1 - y * y) * std::sin(phi);
+		glm::vec3 target = glm::normalize(glm::vec3(x, y, z));
+		if (glm::dot(target, hit.normal) < 0.0f) {
+			target = -target;
+		}
+		scatter.dir = glm::normalize(target);
+		return true;
+	}
+	else if (hit.mtl->metallic) {
+		scatter.dir = 2 * glm::dot(-incidentRay.dir, hit.normal) * hit.normal + incidentRay.dir;	//perfect reflection direction
+		return true;
+	}
+	return false;
+}
+
+inline glm::vec3 skyColor(const glm::vec3& dir) {
+	float t = 0.5f * (dir.y + 1.0f);
+	return (1.0f - t) * glm::vec3(1.0f, 1.0f, 1.0f) + t * glm::vec3(0.5f, 0.7f, 1.0f);
+}
+
+// One shadow ray of SampleLights: the light arrives if nothing is hit before maxT.
+struct ShadowRay {
+	Ray ray;
+	float maxT;
+	glm::vec3 light;			//what it adds per unit of attenuation
+};
+
+// Calls emit(ShadowRay) for the shadow rays SampleLights in PathTracing.glsl traces
+// at a diffuse hit: one toward every point light in front of the surface. The sky
+// is sampled by the cosine distributed scatter ray.
+template <class Emit>
+inline void lightSamples(const std::vector<Light>& lights, const HitInfo& hit, Emit emit) {
+	glm::vec3 origin = hit.position + 1e-3f * hit.normal;
+	for (const Light& light : lights) {
+		glm::vec3 toLight = light.position - origin;
+		float distance2 = glm::dot(toLight, toLight);
+		glm::vec3 dir = toLight / std::sqrt(distance2);
+		float cosine = glm::dot(hit.normal, dir);
+		if (cosine > 0.0f) {
+			emit(ShadowRay{ { origin, dir }, std::sqrt(distance2), light.intensity * cosine / (CPU_PI * distance2) });
+		}
+	}
+}
+
+template <class Intersector>
+inline bool shadowRayBlocked(const Intersector& intersect, const ShadowRay& shadow) {
+	return intersect.occluded(shadow.ray, shadow.maxT);
+}
+
+// SampleLights in PathTracing.glsl: the light reaching a diffuse hit directly
+template <class Intersector>
+inline glm::vec3 sampleLights(const Intersector& intersect, const std::vector<Light>& lights, const HitInfo& hit) {
+	glm::vec3 light(0.0f);
+	lightSamples(lights, hit, [&](const ShadowRay& shadow) {
+		if (!shadowRayBlocked(intersect, shadow)) {
+			light += shadow.light;
+		}
+	});
+	return light;
+}
+
+// TracePath in PathTracing.glsl; intersect is a SimdIntersector, whose
+// intersect(ray, hit) and intersect.occluded(ray, tMax) run the closest and any hit
+// queries with the widest kernels the CPU has. With lights the diffuse hits sample them (NEXT_EVENT 1), without
+// it is the shader built with NEXT_EVENT 0.
+// A path that was started elsewhere (e.g. in a ray packet) continues from
+// firstBounce with the throughput it has gathered so far in color and the light
+// it has sampled in radiance.
+template <class Intersector>
+inline glm::vec3 tracePath(const Intersector& intersect, Ray ray, ShaderRandom& random, const std::vector<Light>* lights = nullptr,
+	int firstBounce = 0, glm::vec3 color = glm::vec3(1.0f), glm::vec3 radiance = glm::vec3(0.0f)) {
+	for (int j = firstBounce; j < CPU_MAX_BOUNCE; j++) {
+		HitInfo hit;
+		if (!intersect(ray, hit)) {
+			return radiance + color * skyColor(ray.dir);
+		}
+		color *= hit.mtl->attenuation;
+		if (lights && hit.mtl->diffuse) {
+			radiance += color * sampleLights(intersect, *lights, hit);
+		}
+		Ray scatter;
+		if (!computeScatterRay(hit, ray, random, scatter, lights != nullptr)) {
+			//material is not defined
+			return glm::vec3(0.0f);
+		}
+		ray = scatter;
+	}
+	//no light path toward the light source with the given depth; the light
+	//sampled on the way is kept
+	return radiance;
+}
+
+#endif
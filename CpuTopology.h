@@ -0,0 +1,129 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// How worker threads are placed on cores:
+// None     threads float wherever the OS puts them (default)
+// Compact  fill every core of NUMA node 0, then node 1, ...
+// Scatter  deal threads round robin over the NUMA nodes
+enum class PinPolicy { None, Compact, Scatter };
+
+struct WorkerPlacement {
+	int cpu = -1;				//-1 = not pinned
+	unsigned int node = 0;
+};
+
+// NUMA nodes and the logical CPUs on each, read from sysfs on Linux. Everywhere
+// else (or when sysfs is missing) the machine is treated as a single node.
+class CpuTopology {
+public:
+	std::vector<std::vector<int>> nodeCpus;
+
+	static CpuTopology detect() {
+		CpuTopology topology;
+#ifdef __linux__
+		for (unsigned int node = 0;; node++) {
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string list;
+			if (!file || !std::getline(file, list)) {
+				break;
+			}
+			std::vector<int> cpus = parseCpuList(list);
+			if (!cpus.empty()) {
+				topology.nodeCpus.push_back(cpus);
+			}
+		}
+#endif
+		if (topology.nodeCpus.empty()) {
+			unsigned int count = std::thread::hardware_concurrency();
+			topology.nodeCpus.push_back({});
+			for (unsigned int cpu = 0; cpu < (count > 0 ? count : 1); cpu++) {
+				topology.nodeCpus[0].push_back((int)cpu);
+			}
+		}
+		return topology;
+	}
+
+	unsigned int nodeCount() const {
+		return (unsigned int)nodeCpus.size();
+	}
+
+	std::vector<WorkerPlacement> place(unsigned int threadCount, PinPolicy policy) const {
+		std::vector<WorkerPlacement> placement(threadCount);
+		if (policy == PinPolicy::None) {
+			return placement;
+		}
+		std::vector<size_t> used(nodeCpus.size(), 0);
+		unsigned int node = 0;
+		for (unsigned int i = 0; i < threadCount; i++) {
+			if (policy == PinPolicy::Scatter) {
+				node = i % nodeCount();
+			}
+			else {
+				while (used[node] >= nodeCpus[node].size() && node + 1 < nodeCount()) {
+					node++;
+				}
+			}
+			//more threads than cores wrap around on the same node
+			const std::vector<int>& cpus = nodeCpus[node];
+			placement[i].cpu = cpus[used[node] % cpus.size()];
+			placement[i].node = node;
+			used[node]++;
+		}
+		return placement;
+	}
+
+	static bool pin(std::thread::native_handle_type thread, int cpu) {
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+		(void)thread;
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	static bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+		return pin(pthread_self(), cpu);
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+private:
+	// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+	static std::vector<int> parseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			if (range.empty()) {
+				continue;
+			}
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+};
+
+#endif
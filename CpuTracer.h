@@ -0,0 +1,217 @@
+#ifndef CPU_TRACER_H
+#define CPU_TRACER_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "CpuPathTracing.h"
+#include "SimdIntersect.h"
+#include "PacketTracer.h"
+#include "WavefrontTracer.h"
+#include "ThreadPool.h"
+
+// CPU implementation of the tracer pass. The image is split into square tiles
+// that the work-stealing thread pool renders in parallel; every call to traceFrame adds one
+// path per pixel to the accumulation buffer, like one frame of the GPU tracer.
+// The accumulation buffer is allocated untouched and cleared tile by tile by the
+// workers that own those tiles, so with pinned threads each NUMA node holds the
+// rows it renders.
+// In wavefront mode a task is a run of tiles traced stage by stage by WavefrontTracer
+// instead of one path at a time.
+class CpuTracer {
+public:
+	static const unsigned int TILE_SIZE = 16;
+
+	CpuTracer(const Scene& scene, unsigned int width, unsigned int height, float fov, unsigned int threadCount = 0, SimdLevel simd = SimdLevel::AVX2,
+		PinPolicy pinning = PinPolicy::None) :
+		scene(scene),
+		intersector(this->scene, simd),
+		packetTracer(this->scene, intersector),
+		wavefrontTracer(this->scene, intersector, WavefrontTracer::defaultWaveSize()),
+		width(width),
+		height(height),
+		fov(fov),
+		pool(threadCount, pinning),
+		accumulation(new glm::vec3[(size_t)width * height]),
+		params(glm::mat4(1.0f), width, height, fov)
+	{
+		tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		tilesPerWave = std::max(1u, wavefrontTracer.pathsPerWave() / (TILE_SIZE * TILE_SIZE));
+		waves.resize(pool.size());
+		wavePixels.resize(pool.size());
+		setNextEventEnabled(true);
+		clearAccumulation();
+	}
+
+	unsigned int threadCount() const {
+		return pool.size();
+	}
+
+	const std::vector<WorkerStats>& workerStats() const {
+		return pool.stats();
+	}
+
+	unsigned int numaNodes() const {
+		return pool.numaNodes();
+	}
+
+	SimdLevel simdLevel() const {
+		return intersector.simdLevel();
+	}
+
+	// trace 8x8 blocks of primary rays as packets; needs AVX2
+	bool setPacketsEnabled(bool enabled) {
+		usePackets = enabled && packetTracer.isAvailable();
+		return usePackets;
+	}
+
+	// trace every path stage by stage in waves of tiles; takes precedence over packets
+	void setWavefrontEnabled(bool enabled) {
+		useWavefront = enabled;
+	}
+
+	// sample the lights at diffuse hits (on by default), like the shaders built
+	// with NEXT_EVENT; off is the original estimator
+	void setNextEventEnabled(bool enabled) {
+		nextEvent = enabled;
+		packetTracer.setNextEventEnabled(enabled);
+		wavefrontTracer.setNextEventEnabled(enabled);
+	}
+
+	unsigned int pathsPerWave() const {
+		return tilesPerWave * TILE_SIZE * TILE_SIZE;
+	}
+
+	unsigned int sampleCount() const {
+		return samples;
+	}
+
+	// changing the view restarts the accumulation, like cameraIsMoving in the shader
+	void setView(const glm::mat4& view) {
+		params = PrimaryRayParams(view, width, height, fov);
+		this->view = view;
+		clearAccumulation();
+	}
+
+	void traceFrame() {
+		//same distribution as the randomVector uniform in Renderer::traceFrame
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		glm::vec2 randomVector(uniform(generator), 0.5f * uniform(generator));
+		if (useWavefront) {
+			unsigned int tiles = tilesX * tilesY;
+			pool.run((tiles + tilesPerWave - 1) / tilesPerWave, [&](unsigned int wave, unsigned int worker) {
+				traceWave(wave, worker, randomVector);
+			});
+		}
+		else {
+			pool.run(tilesX * tilesY, [&](unsigned int tile, unsigned int) {
+				traceTile(tile, randomVector);
+			});
+		}
+		samples++;
+	}
+
+	// averaged image as RGBA8, bottom row first like glReadPixels
+	std::vector<unsigned char> resolve() const {
+		std::vector<unsigned char> pixels((size_t)width * height * 4);
+		float scale = samples > 0 ? 1.0f / samples : 0.0f;
+		for (size_t i = 0; i < (size_t)width * height; i++) {
+			glm::vec3 color = glm::clamp(accumulation[i] * scale, 0.0f, 1.0f);
+			pixels[i * 4 + 0] = (unsigned char)std::lround(color.r * 255.0f);
+			pixels[i * 4 + 1] = (unsigned char)std::lround(color.g * 255.0f);
+			pixels[i * 4 + 2] = (unsigned char)std::lround(color.b * 255.0f);
+			pixels[i * 4 + 3] = 255;
+		}
+		return pixels;
+	}
+
+private:
+	Scene scene;
+	SimdIntersector intersector;
+	PacketTracer packetTracer;
+	bool usePackets = false;
+	WavefrontTracer wavefrontTracer;
+	bool useWavefront = false;
+	bool nextEvent = true;
+	unsigned int tilesPerWave = 1;
+	std::vector<WavefrontTracer::Wave> waves;				//one set of queues per worker
+	std::vector<std::vector<unsigned int>> wavePixels;
+	unsigned int width;
+	unsigned int height;
+	float fov;
+	ThreadPool pool;
+	std::unique_ptr<glm::vec3[]> accumulation;		//deliberately not value-initialized
+	PrimaryRayParams params;
+	glm::mat4 view = glm::mat4(1.0f);
+	unsigned int tilesX = 0;
+	unsigned int tilesY = 0;
+	unsigned int samples = 0;
+	std::mt19937 generator{ 5489u };
+
+	// runs on the same workers, with the same tile split, as traceFrame without stealing
+	void clearAccumulation() {
+		pool.run(tilesX * tilesY, [&](unsigned int tile, unsigned int) {
+			unsigned int x0 = (tile % tilesX) * TILE_SIZE;
+			unsigned int y0 = (tile / tilesX) * TILE_SIZE;
+			unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+			unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+			for (unsigned int y = y0; y < y1; y++) {
+				glm::vec3* row = accumulation.get() + (size_t)y * width;
+				std::fill(row + x0, row + x1, glm::vec3(0.0f));
+			}
+		}, false);
+		pool.resetStats();
+		samples = 0;
+	}
+
+	void traceWave(unsigned int wave, unsigned int worker, const glm::vec2& randomVector) {
+		std::vector<unsigned int>& pixels = wavePixels[worker];
+		pixels.clear();
+		unsigned int lastTile = std::min((wave + 1) * tilesPerWave, tilesX * tilesY);
+		for (unsigned int tile = wave * tilesPerWave; tile < lastTile; tile++) {
+			unsigned int x0 = (tile % tilesX) * TILE_SIZE;
+			unsigned int y0 = (tile / tilesX) * TILE_SIZE;
+			unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+			unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+			for (unsigned int y = y0; y < y1; y++) {
+				for (unsigned int x = x0; x < x1; x++) {
+					pixels.push_back(y * width + x);
+				}
+			}
+		}
+		wavefrontTracer.traceWave(waves[worker], pixels, params, randomVector, accumulation.get());
+	}
+
+	void traceTile(unsigned int tile, const glm::vec2& randomVector) {
+		unsigned int x0 = (tile % tilesX) * TILE_SIZE;
+		unsigned int y0 = (tile / tilesX) * TILE_SIZE;
+		unsigned int x1 = std::min(x0 + TILE_SIZE, width);
+		unsigned int y1 = std::min(y0 + TILE_SIZE, height);
+		if (usePackets) {
+			for (unsigned int by = y0; by < y1; by += PacketTracer::PACKET_SIZE) {
+				for (unsigned int bx = x0; bx < x1; bx += PacketTracer::PACKET_SIZE) {
+					packetTracer.traceBlock(params, view, randomVector, bx, by,
+						std::min(bx + PacketTracer::PACKET_SIZE, x1), std::min(by + PacketTracer::PACKET_SIZE, y1), accumulation.get(), width);
+				}
+			}
+			return;
+		}
+		for (unsigned int y = y0; y < y1; y++) {
+			for (unsigned int x = x0; x < x1; x++) {
+				glm::vec2 fragCoord(x + 0.5f, y + 0.5f);
+				ShaderRandom random = { fragCoord, randomVector };
+				Ray ray = generatePrimaryRay(params, params.pixelPos(fragCoord.x, fragCoord.y), random);
+				accumulation[(size_t)y * width + x] += tracePath(intersector, ray, random, nextEvent ? &scene.lights : nullptr);
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports which of a set of files changed on disk, without blocking. On Linux it
+// listens to inotify events on the files' directories rather than on the files,
+// since many editors save by writing a new file and renaming it over the old one.
+// Elsewhere, or when inotify is not available, it compares modification times,
+// at most once per POLL_INTERVAL. Events are matched by canonical path, so one
+// directory watched under different spellings ("", "./", absolute) still reports
+// every file under the spelling it was watched with.
+class FileWatcher {
+public:
+	static constexpr std::chrono::milliseconds POLL_INTERVAL = std::chrono::milliseconds(250);
+
+	FileWatcher() {
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+	}
+
+	~FileWatcher() {
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			close(inotifyFd);
+		}
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	void watch(const std::string& path) {
+		for (const WatchedFile& file : files) {
+			if (file.path == path) {
+				return;
+			}
+		}
+		std::filesystem::path canonical = canonicalPath(path);
+		files.push_back({ path, canonical.string(), modificationTime(path) });
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			std::string directory = canonical.parent_path().string();
+			for (const auto& watched : directories) {
+				if (watched.second == directory) {
+					return;
+				}
+			}
+			int descriptor = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (descriptor >= 0) {
+				directories[descriptor] = directory;
+			}
+		}
+#endif
+	}
+
+	bool usesInotify() const {
+#ifdef __linux__
+		return inotifyFd >= 0;
+#else
+		return false;
+#endif
+	}
+
+	// the watched files written since the last call, each listed once
+	std::vector<std::string> poll() {
+		std::vector<std::string> changed;
+#ifdef __linux__
+		if (inotifyFd >= 0) {
+			alignas(inotify_event) char buffer[4096];
+			ssize_t length;
+			while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+				for (char* next = buffer; next < buffer + length;) {
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+					next += sizeof(inotify_event) + event->len;
+					auto directory = directories.find(event->wd);
+					if (event->len == 0 || directory == directories.end()) {
+						continue;
+					}
+					std::string canonical = (std::filesystem::path(directory->second) / event->name).string();
+					for (const WatchedFile& file : files) {
+						if (file.canonical == canonical && std::find(changed.begin(), changed.end(), file.path) == changed.end()) {
+							changed.push_back(file.path);
+						}
+					}
+				}
+			}
+			return changed;
+		}
+#endif
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastPoll < POLL_INTERVAL) {
+			return changed;
+		}
+		lastPoll = now;
+		for (WatchedFile& file : files) {
+			std::filesystem::file_time_type time = modificationTime(file.path);
+			if (time != file.modified) {
+				file.modified = time;
+				changed.push_back(file.path);
+			}
+		}
+		return changed;
+	}
+
+private:
+	struct WatchedFile {
+		std::string path;			//as passed to watch() and reported by poll()
+		std::string canonical;
+		std::filesystem::file_time_type modified;
+	};
+
+	std::vector<WatchedFile> files;
+	std::chrono::steady_clock::time_point lastPoll;
+#ifdef __linux__
+	int inotifyFd = -1;
+	std::map<int, std::string> directories;		//watch descriptor -> canonical directory
+#endif
+
+	// absolute, without "." or ".." and with symlinks resolved as far as they exist
+	static std::filesystem::path canonicalPath(const std::string& path) {
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(path, error), error);
+		return error ? std::filesystem::path(path) : canonical;
+	}
+
+	static std::filesystem::file_time_type modificationTime(const std::string& path) {
+		std::error_code error;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+		return error ? std::filesystem::file_time_type::min() : time;
+	}
+};
+
+#endif
@@ -1,208 +1,18 @@
-#version 460 core
-#define NUM_SPHERES	7
-#define NUM_PLANES	5
-#define NUM_LIGHTS	1
-#define MAX_BOUNCE 50
-#define PI        3.14159265358979323
+#version 450 core
 
-out vec4 FragColor;
+//the stencil test of a convergence mask runs before the shader, so masked pixels cost nothing
+layout(early_fragment_tests) in;
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out float LuminanceSquares;
 in vec3 pixelPos;
 
-struct Ray{
-	vec3 pos;
-	vec3 dir;
-};
-
-struct Material{
-	bool diffuse;
-	bool metallic;
-	vec3 attenuation;
-};
-
-struct HitInfo{
-	float t;
-	vec3 position;
-	vec3 normal;
-	Material mtl;
-	bool frontFace;
-};
-
-struct Sphere{
-	vec3 center;
-	float radius;
-	Material mtl;
-};
-
-struct Plane{
-	vec3 normal;
-	vec3 position;
-	float lenght;
-	Material mtl;
-};
-
-struct Light{
-	vec3 position;
-	vec3 intensity;
-};
-
-uniform Sphere spheres[NUM_SPHERES];
-uniform Plane planes[NUM_PLANES];
-uniform Light lights[NUM_LIGHTS];
-uniform mat4 c2w;
-uniform float view_pixel_width;		//width of viewport pixel
-uniform float view_pixel_height;		
-uniform vec2 randomVector;
-
-Ray GeneratePrimaryRay();
-Ray ComputeScatterRay(HitInfo hit, Ray incidentRay);
-bool IntersectRay(inout HitInfo hit,Ray ray);
-vec3 Shade(vec3 position, vec3 normal, vec3 view, Material mtl);
-float rand( );
-
-vec2 seed;
-vec3 cameraPos;
-vec3 errorRay = vec3(2,2,2);
-
-
-//new
-uniform sampler2D resultTexture;
-uniform uint width;
-uniform uint height;
-uniform bool cameraIsMoving;
+#include "PathTracing.glsl"
 
 void main(){
-	cameraPos = (c2w*vec4(0.0f, 0.0f, 0.0f,1.0f)).xyz;
-	seed = gl_FragCoord.xy;
-	
-	Ray ray = GeneratePrimaryRay();
-	vec3 color = vec3(1.0f,1.0f,1.0f);
-	int depth = MAX_BOUNCE;
-		
-	for(int j = 0 ; j < MAX_BOUNCE ; j++){		
-		HitInfo hit;
-		if(IntersectRay(hit, ray)){
-			color *= hit.mtl.attenuation;
-			ray = ComputeScatterRay(hit, ray);
-			if(ray.dir == errorRay){
-				//material is not defined
-				color *= vec3(0,0,0);
-				break;
-			}
-		}
-		else{	
-			//sky color
-			float t = 0.5*(ray.dir.y + 1.0);
-			color *= (1.0-t)*vec3(1.0, 1.0, 1.0) + t*vec3(0.5, 0.7, 1.0);
-			break;
-		}
-		depth--;
-	}
-	if(depth <= 0){	
-		//no light path toward the light source with the given depth
-		color *= vec3(0);
-	}
-
-	vec3 prevColor = cameraIsMoving ? vec3(0) : texture(resultTexture, vec2(gl_FragCoord.x / float(width), gl_FragCoord.y / float(height))).rgb;
-	FragColor = vec4(prevColor + color,1);
+	float squares;
+	vec3 color = TracePixel(gl_FragCoord.xy, pixelPos, squares);
+	//added to the accumulation textures by GL_ONE, GL_ONE blending: the color with
+	//the sample count in alpha, and the squared luminances (Statistics.glsl)
+	FragColor = vec4(color, samplesPerPixel);
+	LuminanceSquares = squares;
 }
-
-Ray ComputeScatterRay(HitInfo hit, Ray incidentRay)
-{
-	Ray scatter;
-	scatter.pos = hit.position + 1e-3 * hit.normal;
-
-	if(hit.mtl.diffuse){												
-		float y =  rand() * 2.0 -1.0;
-		float phi = 2*PI*rand();
-		float x = sqrt(1-y*y)*cos(phi);
-		float z = sqrt(1-y*y)*sin(phi);
-		vec3 target = normalize(vec3 (x,y,z));
-		if(dot(target,hit.normal) < 0.0f){
-			target = -target;
-		}
-		//target = scatter.pos + target;
-		//scatter.dir = normalize(target - scatter.pos);
-		scatter.dir = normalize(target);
-		return scatter;
-	}
-	else if(hit.mtl.metallic){
-		scatter.dir = 2*dot(-incidentRay.dir,hit.normal)*hit.normal + incidentRay.dir;	//perfect reflection direction
-		return scatter;
-	}
-	else{
-		scatter.dir = errorRay;
-		return scatter;
-	}
-
-}
-
-bool IntersectRay(inout HitInfo hit,Ray ray){
-	hit.t = 1e30;
-	bool foundHit = false;
-	for(int i = 0 ; i < NUM_SPHERES ; i++){									//spheres 
-		vec3 center = spheres[i].center;
-		vec3 tmp = ray.pos - center;
-		float a = dot(ray.dir, ray.dir);
-		float b = 2 * dot(ray.dir,tmp);
-		float c = dot(tmp, tmp) - spheres[i].radius*spheres[i].radius;
-		float delta = b*b - 4*a*c;
-		if(delta >= 0.0f){
-			float t;
-			if(length(ray.pos - center) < spheres[i].radius){				//ray origin is inside the sphere																	
-				t = (-b + sqrt(delta))/ 2.0 * a; 
-			}
-			else{
-				t = (-b - sqrt(delta))/ 2.0 * a; 
-			}
-			if( t < hit.t && t > 0.0f){
-				hit.t = t;
-				hit.position = ray.pos + t*ray.dir;
-				hit.normal = normalize(hit.position - center);
-				hit.frontFace = dot(ray.dir,hit.normal) < 0.0f;
-				hit.normal = hit.frontFace ? hit.normal : -hit.normal;
-				hit.mtl = spheres[i].mtl;
-				foundHit = true;
-			}
-		}
-	}
-	for(int i = 0 ; i < NUM_PLANES ; i++){									//plane count
-		float denominator = dot(ray.dir, planes[i].normal);
-		if(denominator != 0.0f){											//plane and ray are not perpendicular			
-			float c = dot(planes[i].normal, planes[i].position);
-			float t = (c - dot(ray.pos, planes[i].normal)) / denominator;
-			vec3 positionOnPlane = ray.pos + t*ray.dir;
-			vec3 distance = positionOnPlane - planes[i].position;
-			if(abs(distance.x) < planes[i].lenght && abs(distance.y) < planes[i].lenght && abs(distance.z) < planes[i].lenght){
-				if( t < hit.t && t > 0.0f ){
-					hit.t = t;
-					hit.position = positionOnPlane;
-					hit.normal = planes[i].normal;
-					hit.frontFace = dot(ray.dir,planes[i].normal) < 0.0f;
-					hit.normal = hit.frontFace ? hit.normal : -hit.normal;
-					hit.mtl = planes[i].mtl;
-					foundHit = true;
-				}
-			}
-		}
-	}
-	return foundHit;
-}
-
-Ray GeneratePrimaryRay(){
-	float n = rand();													//0, 1
-	float y = view_pixel_width * (n-1) + 0.5f*view_pixel_width	;			// -1/2*view_pixel_width , 1/2*view_pixel_width
-	float offsetX = y;
-	n = rand();															//0, 1
-	y = view_pixel_height * (n-1) + 0.5f*view_pixel_height	;				// -1/2*view_pixel_width , 1/2*view_pixel_width
-	float offsetY = y;
-
-	Ray ray;
-	ray.pos = pixelPos + vec3(offsetX, offsetY, 0.0f);
-	ray.dir = normalize(ray.pos - cameraPos);
-	return ray;
-}
-
-float rand(){
-	seed-=randomVector;
-	return fract(sin(dot(seed.xy ,vec2(12.9898,78.233))) * 43758.5453);
-}
\ No newline at end of file
@@ -0,0 +1,9 @@
+// Per frame camera state shared by every pass, filled by FrameUniforms with a
+// single buffer upload per frame. The layout is mirrored by FrameUniforms.h.
+layout(std140) uniform FrameData{
+	mat4 c2w;
+	vec3 cameraPos;			//c2w * (0, 0, 0, 1)
+	bool cameraIsMoving;
+	vec2 randomVector;
+	uint samplesPerPixel;	//paths a tracer pass adds to each pixel
+};
@@ -0,0 +1,102 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+// std140 copy of the FrameData block in FrameData.glsl
+struct GpuFrameData {
+	glm::mat4 c2w;
+	glm::vec3 cameraPos;
+	GLuint cameraIsMoving;
+	glm::vec2 randomVector;
+	GLuint samplesPerPixel;
+	GLuint padding;
+};
+
+static_assert(offsetof(GpuFrameData, cameraPos) == 64 && offsetof(GpuFrameData, cameraIsMoving) == 76 &&
+	offsetof(GpuFrameData, randomVector) == 80 && offsetof(GpuFrameData, samplesPerPixel) == 88 && sizeof(GpuFrameData) == 96,
+	"GpuFrameData must match the std140 layout of FrameData");
+
+// The per frame uniforms of all passes in one uniform buffer. The setters only
+// change the CPU copy; upload() writes it with a single glBufferSubData when
+// something changed and binds the buffer, so every program that was attached
+// sees the same values without any glUniform calls.
+class FrameUniforms {
+public:
+	static const GLuint BINDING = 0;
+
+	FrameUniforms() {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(GpuFrameData), &data, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	~FrameUniforms() {
+		glDeleteBuffers(1, &buffer);
+	}
+
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	// points the program's FrameData block at this buffer; programs without it are left alone
+	void attach(const Shader& shader) const {
+		shader.bindUniformBlock("FrameData", BINDING);
+	}
+
+	void setCamera(const glm::mat4& c2w) {
+		if (c2w != data.c2w) {
+			data.c2w = c2w;
+			data.cameraPos = glm::vec3(c2w * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			dirty = true;
+		}
+	}
+
+	void setCameraIsMoving(bool moving) {
+		if ((data.cameraIsMoving != 0) != moving) {
+			data.cameraIsMoving = moving;
+			dirty = true;
+		}
+	}
+
+	void setRandomVector(const glm::vec2& randomVector) {
+		if (randomVector != data.randomVector) {
+			data.randomVector = randomVector;
+			dirty = true;
+		}
+	}
+
+	void setSamplesPerPixel(unsigned int samples) {
+		if (samples != data.samplesPerPixel) {
+			data.samplesPerPixel = samples;
+			dirty = true;
+		}
+	}
+
+	const glm::mat4& camera() const {
+		return data.c2w;
+	}
+
+	void upload() {
+		if (dirty) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GpuFrameData), &data);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			dirty = false;
+		}
+		glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+	}
+
+private:
+	GpuFrameData data = { glm::mat4(1.0f), glm::vec3(0.0f), 0, glm::vec2(0.0f), 1, 0 };
+	GLuint buffer = 0;
+	bool dirty = false;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstring>
+
+// GL_TIME_ELAPSED queries around a pass, kept in a small ring and read back a few
+// frames later: a query is only read once GL_QUERY_RESULT_AVAILABLE says so, so
+// timing never makes the CPU wait for the GPU. Each measurement carries a tag
+// (e.g. the samples per pixel the pass traced) back to the caller. Queries of one
+// target cannot nest, so the timed pass must not start its own.
+// Software rasterizers run the shaders outside of what their queries measure
+// (llvmpipe reports a few percent of the real time), so on those the timer
+// waits for the pass with glFinish and measures wall time instead.
+class GpuTimer {
+public:
+	static const unsigned int RING_SIZE = 4;
+
+	GpuTimer() :
+		wallClock(isSoftwareRenderer())
+	{
+		glGenQueries(RING_SIZE, queries);
+	}
+
+	~GpuTimer() {
+		glDeleteQueries(RING_SIZE, queries);
+	}
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	// Starts timing. Returns false when every query is still waiting for its
+	// result; the pass then goes untimed rather than stalling.
+	bool begin() {
+		if (timing || inFlight == RING_SIZE) {
+			return false;
+		}
+		if (wallClock) {
+			glFinish();
+			start = std::chrono::steady_clock::now();
+		}
+		else {
+			glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+		}
+		timing = true;
+		return true;
+	}
+
+	// ends the query started by begin(), if it started one
+	void end(unsigned int tag) {
+		if (!timing) {
+			return;
+		}
+		if (wallClock) {
+			glFinish();
+			wallMs[next] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		else {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+		tags[next] = tag;
+		next = (next + 1) % RING_SIZE;
+		inFlight++;
+		timing = false;
+	}
+
+	unsigned int pending() const {
+		return inFlight;
+	}
+
+	// Takes the oldest measurement if its result is there. With wait it blocks
+	// for it instead, for callers with no frame rate to keep.
+	bool collect(double& ms, unsigned int& tag, bool wait = false) {
+		if (inFlight == 0) {
+			return false;
+		}
+		unsigned int oldest = (next + RING_SIZE - inFlight) % RING_SIZE;
+		if (wallClock) {
+			ms = wallMs[oldest];
+			tag = tags[oldest];
+			inFlight--;
+			return true;
+		}
+		if (!wait) {
+			GLint available = 0;
+			glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				return false;
+			}
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &nanoseconds);
+		ms = nanoseconds / 1e6;
+		tag = tags[oldest];
+		inFlight--;
+		return true;
+	}
+
+private:
+	bool wallClock;
+	GLuint queries[RING_SIZE] = {};
+	unsigned int tags[RING_SIZE] = {};
+	double wallMs[RING_SIZE] = {};
+	std::chrono::steady_clock::time_point start;
+	unsigned int next = 0;			//query the next begin() uses
+	unsigned int inFlight = 0;		//ended queries not collected yet, the ones before next
+	bool timing = false;
+
+	static bool isSoftwareRenderer() {
+		const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		return renderer != NULL && (strstr(renderer, "llvmpipe") != NULL || strstr(renderer, "softpipe") != NULL ||
+			strstr(renderer, "SwiftShader") != NULL);
+	}
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef GPU_WAVEFRONT_H
+#define GPU_WAVEFRONT_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "SceneBuffers.h"
+#include "FrameUniforms.h"
+#include "ShaderLibrary.h"
+
+// Wavefront version of the GPU tracer pass, built from the Wavefront.comp stages.
+// Path state and two ray queues live in SSBOs; after every bounce the shade stage
+// has appended the rays still alive to the other queue and the compact stage
+// writes their count into the indirect dispatch arguments, so each bounce only
+// launches workgroups for live rays. All bounces are recorded without reading
+// anything back; once every path has ended the remaining dispatches are empty.
+class GpuWavefront {
+public:
+	static const unsigned int WORKGROUP_SIZE = 64;
+
+	// the scene buffers and frame uniforms are bound by the caller (SceneBuffers::bind,
+	// FrameUniforms::upload) before traceFrame
+	// The stages are built from the library with the scene's variant defines; with an
+	// asynchronous compiler the four programs build at the same time, see isReady.
+	GpuWavefront(unsigned int width, unsigned int height, float fov, const FrameUniforms& frame,
+		ShaderLibrary& library, const std::string& variantDefines) :
+		width(width),
+		height(height),
+		fov(fov),
+		maxBounce(library.maxBounce()),
+		frame(frame),
+		generateShader(library.compute("Wavefront.comp", stageDefines("STAGE_GENERATE") + variantDefines)),
+		intersectShader(library.compute("Wavefront.comp", stageDefines("STAGE_INTERSECT") + variantDefines)),
+		shadeShader(library.compute("Wavefront.comp", stageDefines("STAGE_SHADE") + variantDefines)),
+		compactShader(library.compute("Wavefront.comp", stageDefines("STAGE_COMPACT") + variantDefines))
+	{
+
+		size_t pathCount = (size_t)width * height;
+		glGenBuffers(1, &pathBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, pathCount * PATH_STATE_SIZE, NULL, GL_DYNAMIC_COPY);
+		glGenBuffers(2, queueBuffers);
+		for (GLuint queue : queueBuffers) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, queue);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, pathCount * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		}
+		//dispatchSize (uvec3), queueCount, nextCount
+		GLuint counters[5] = { 0, 1, 1, 0, 0 };
+		glGenBuffers(1, &counterBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	~GpuWavefront() {
+		glDeleteBuffers(1, &pathBuffer);
+		glDeleteBuffers(2, queueBuffers);
+		glDeleteBuffers(1, &counterBuffer);
+	}
+
+	// true once every stage program is built; sets their uniforms the first time
+	bool isReady() {
+		if (configured) {
+			return true;
+		}
+		bool ready = true;
+		for (Shader* stage : { generateShader.get(), intersectShader.get(), shadeShader.get(), compactShader.get() }) {
+			ready = stage->isReady() && ready;
+		}
+		if (ready) {
+			for (const Shader* stage : { generateShader.get(), intersectShader.get(), shadeShader.get() }) {
+				setImageUniforms(*stage, width, height, fov);
+				frame.attach(*stage);
+			}
+			sampleIndexLocation = generateShader->uniformLocation("sampleIndex");
+			configured = true;
+		}
+		return ready;
+	}
+
+	// the stage programs were swapped for rebuilt ones; isReady sets their uniforms again
+	void programsReloaded() {
+		configured = false;
+	}
+
+	// adds samples paths per pixel to the rgba32f accumulation texture and their
+	// squared luminances to the r32f squares texture, one round of generate and
+	// bounce dispatches per sample since there is path state for one path per
+	// pixel; needs isReady()
+	void traceFrame(GLuint accumulation, GLuint squares, unsigned int samples = 1) {
+		glBindImageTexture(0, accumulation, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		glBindImageTexture(1, squares, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pathBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+		for (unsigned int sample = 0; sample < samples; sample++) {
+			traceSample(sample);
+		}
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+private:
+	//std430 size of PathState in Wavefront.comp
+	static const size_t PATH_STATE_SIZE = 96;
+
+	unsigned int width;
+	unsigned int height;
+	float fov;
+	unsigned int maxBounce;					//MAX_BOUNCE of the variant
+	const FrameUniforms& frame;
+	bool configured = false;
+	std::shared_ptr<Shader> generateShader;
+	std::shared_ptr<Shader> intersectShader;
+	std::shared_ptr<Shader> shadeShader;
+	std::shared_ptr<Shader> compactShader;
+	GLint sampleIndexLocation = -1;
+	GLuint pathBuffer = 0;
+	GLuint queueBuffers[2] = { 0, 0 };
+	GLuint counterBuffer = 0;
+
+	void traceSample(unsigned int sample) {
+		unsigned int current = 0;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, queueBuffers[current]);
+		generateShader->use();
+		generateShader->setUInt(sampleIndexLocation, sample);
+		glDispatchCompute((width * height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+		for (unsigned int bounce = 0; bounce < maxBounce; bounce++) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, queueBuffers[current]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, queueBuffers[1 - current]);
+
+			intersectShader->use();
+			glDispatchComputeIndirect(0);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			shadeShader->use();
+			glDispatchComputeIndirect(0);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			compactShader->use();
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+			current = 1 - current;
+		}
+	}
+
+	static std::string stageDefines(const char* stage) {
+		return std::string("#define ") + stage + "\n#define WORKGROUP_SIZE " + std::to_string(WORKGROUP_SIZE) + "\n";
+	}
+};
+
+#endif
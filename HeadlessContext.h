@@ -0,0 +1,136 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <iostream>
+
+#ifdef __linux__
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// Creates an OpenGL core context without a window or display connection so the
+// tracer can run on render nodes. On Linux this is an EGL surfaceless context,
+// which also works with Mesa's llvmpipe software rasterizer.
+class HeadlessContext {
+public:
+	~HeadlessContext() {
+		destroy();
+	}
+
+	bool create() {
+#ifdef __linux__
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay == NULL) {
+			std::cout << "ERROR::HEADLESS::EGL_EXT_platform_base is not supported" << std::endl;
+			return false;
+		}
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			std::cout << "ERROR::HEADLESS::Failed to initialize a surfaceless EGL display" << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			std::cout << "ERROR::HEADLESS::EGL does not support desktop OpenGL" << std::endl;
+			return false;
+		}
+		ownsDisplay = true;
+		if (!createContext(EGL_NO_CONTEXT)) {
+			return false;
+		}
+		if (!makeCurrent()) {
+			std::cout << "ERROR::HEADLESS::Failed to make the context current" << std::endl;
+			return false;
+		}
+		return true;
+#else
+		std::cout << "ERROR::HEADLESS::Headless rendering is only available on Linux (EGL)" << std::endl;
+		return false;
+#endif
+	}
+
+	// A second context on the display of parent that shares its objects (programs,
+	// buffers, textures), e.g. for a worker thread that compiles shaders. It is not
+	// made current; the thread that uses it calls makeCurrent.
+	bool createShared(const HeadlessContext& parent) {
+#ifdef __linux__
+		display = parent.display;
+		ownsDisplay = false;
+		return display != EGL_NO_DISPLAY && createContext(parent.context);
+#else
+		return false;
+#endif
+	}
+
+	// makes the context current on the calling thread
+	bool makeCurrent() const {
+#ifdef __linux__
+		return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+#else
+		return false;
+#endif
+	}
+
+	// detaches the context from the calling thread
+	void release() const {
+#ifdef __linux__
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+	}
+
+	void destroy() {
+#ifdef __linux__
+		if (display != EGL_NO_DISPLAY) {
+			if (ownsDisplay) {
+				eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			}
+			if (context != EGL_NO_CONTEXT) {
+				eglDestroyContext(display, context);
+			}
+			if (ownsDisplay) {
+				eglTerminate(display);
+			}
+		}
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+#endif
+	}
+
+	static void* getProcAddress(const char* name) {
+#ifdef __linux__
+		return (void*)eglGetProcAddress(name);
+#else
+		return NULL;
+#endif
+	}
+
+private:
+#ifdef __linux__
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	bool ownsDisplay = false;
+
+	bool createContext(EGLContext share) {
+		//prefer 4.6, but llvmpipe and older drivers stop at 4.5
+		const EGLint minorVersions[] = { 6, 5 };
+		for (EGLint glMinor : minorVersions) {
+			EGLint attributes[] = {
+				EGL_CONTEXT_MAJOR_VERSION, 4,
+				EGL_CONTEXT_MINOR_VERSION, glMinor,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+				EGL_NONE
+			};
+			context = eglCreateContext(display, EGL_NO_CONFIG_KHR, share, attributes);
+			if (context != EGL_NO_CONTEXT) {
+				return true;
+			}
+		}
+		std::cout << "ERROR::HEADLESS::Failed to create an OpenGL 4.5+ core context" << std::endl;
+		return false;
+	}
+#endif
+};
+
+#endif
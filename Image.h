@@ -0,0 +1,70 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes 8-bit RGBA pixels, stored bottom row first as glReadPixels returns them,
+// to a binary PPM file.
+inline bool writePPM(const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgba) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<unsigned char> row(width * 3);
+	for (unsigned int y = 0; y < height; y++) {
+		const unsigned char* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+		for (unsigned int x = 0; x < width; x++) {
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
+
+// Reads a binary PPM written by writePPM back into bottom-up RGBA8 pixels.
+inline bool readPPM(const std::string& path, unsigned int& width, unsigned int& height, std::vector<unsigned char>& rgba) {
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	unsigned int maxValue;
+	if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255) {
+		return false;
+	}
+	file.get();
+	std::vector<unsigned char> row(width * 3);
+	rgba.assign((size_t)width * height * 4, 255);
+	for (unsigned int y = 0; y < height; y++) {
+		if (!file.read((char*)row.data(), row.size())) {
+			return false;
+		}
+		unsigned char* dst = &rgba[(size_t)(height - 1 - y) * width * 4];
+		for (unsigned int x = 0; x < width; x++) {
+			dst[x * 4 + 0] = row[x * 3 + 0];
+			dst[x * 4 + 1] = row[x * 3 + 1];
+			dst[x * 4 + 2] = row[x * 3 + 2];
+		}
+	}
+	return true;
+}
+
+// root mean square error over the RGB channels of two equally sized RGBA8 images, in [0, 1]
+inline double imageRMSE(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+		if (i % 4 == 3) {
+			continue;
+		}
+		double d = (a[i] - b[i]) / 255.0;
+		sum += d * d;
+		count++;
+	}
+	return count > 0 ? std::sqrt(sum / count) : 0.0;
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "SimdIntersect.h"
+#include "CpuTopology.h"
+#include "Renderer.h"
+#include "SampleBatch.h"
+
+enum class RendererType { GPU, CPU };
+
+struct RenderOptions {
+	bool headless = false;
+	unsigned int width = 1280;
+	unsigned int height = 720;
+	unsigned int samples = 64;
+	std::string output = "render.ppm";
+	std::string compare;
+	RendererType renderer = RendererType::GPU;
+	TracerType tracer = TracerType::Fragment;
+	glm::uvec2 workgroup = glm::uvec2(8, 8);
+	unsigned int tileSize = 0;				//0 = one dispatch for the whole image
+	unsigned int persistentGroups = 0;		//0 = Renderer's default
+	unsigned int threads = 0;				//0 = one per hardware thread
+	SimdLevel simd = SimdLevel::AVX2;		//capped to what the CPU supports
+	bool packets = false;
+	bool wavefront = false;
+	bool workerStats = false;
+	PinPolicy pinning = PinPolicy::None;
+	bool benchIntersect = false;
+	bool benchTracers = false;
+	unsigned int extraSpheres = 0;
+	std::string scene;						//scene file, empty = the built-in default scene
+	bool watch = false;
+	std::string shaderCache = "shader_cache";	//empty = no program binary cache
+	CompileMode shaderCompile = CompileMode::Parallel;
+	bool uberShader = false;				//true = one tracer program for every scene
+	unsigned int maxBounce = ShaderLibrary::DEFAULT_MAX_BOUNCE;	//gpu tracers
+	bool benchVariants = false;
+	unsigned int samplesPerPass = 1;		//gpu tracers, fixed unless frameTime is set
+	double frameTime = 0.0;					//ms of GPU time per tracer pass, 0 = no target
+	bool timeSlice = false;					//window: trace a budget of tiles per frame
+	float converge = 0.0f;					//relative error at which pixels stop, 0 = never
+	bool adaptive = false;					//gpu: samples per tile follow its estimated error
+	bool benchAdaptive = false;
+	double tolerance = 0.0;					//headless: stop at this estimated relative RMSE, 0 = off
+	double timeBudget = 0.0;				//headless: stop after this many seconds, 0 = off
+	bool nextEvent = true;					//sample the lights at diffuse hits
+	bool benchNextEvent = false;
+};
+
+inline void printUsage(const char* program) {
+	std::cout << "usage: " << program << " [options]\n"
+		<< "  --headless          render offscreen without a window and write the image to disk\n"
+		<< "  --width <n>         image width (default 1280)\n"
+		<< "  --height <n>        image height (default 720)\n"
+		<< "  --samples <n>       samples per pixel for headless renders (default 64)\n"
+		<< "  --output <file>     output image for headless renders, binary PPM (default render.ppm)\n"
+		<< "  --renderer <type>   gpu (default) or cpu, the C++ reference tracer (headless only)\n"
+		<< "  --tracer <type>     gpu tracer pass: fragment (default), compute, wavefront (compute stages\n"
+		<< "                      with SSBO ray queues and indirect dispatches per bounce) or persistent\n"
+		<< "                      (fixed workgroups pulling pixels from a global counter)\n"
+		<< "  --persistent-groups <n>\n"
+		<< "                      workgroups launched by the persistent tracer (default 256)\n"
+		<< "  --workgroup <WxH>   compute tracer workgroup size, e.g. 8x8 (default), 16x16 or 32x4\n"
+		<< "  --tile <n>          compute tracer: dispatch the image as independent n x n pixel tiles\n"
+		<< "  --threads <n>       worker threads for the cpu renderer (default: all hardware threads)\n"
+		<< "  --simd <level>      widest intersection kernel for the cpu renderer: avx2 (default), sse or scalar\n"
+		<< "  --pin <policy>      pin cpu renderer threads: none (default), compact (fill one NUMA node first)\n"
+		<< "                      or scatter (round robin over nodes); each node first-touches the rows it renders\n"
+		<< "  --worker-stats      print per thread utilization and steal counts of the cpu renderer\n"
+		<< "  --packets           trace primary rays of the cpu renderer as 8x8 SIMD packets (AVX2)\n"
+		<< "  --wavefront         run the cpu renderer as a wavefront: all paths of a batch of tiles go through\n"
+		<< "                      generate, extend, miss, diffuse, metallic and shadow stages one stage at a time\n"
+		<< "  --scene <file>      load the scene from a text file (see Scene.txt) instead of the built-in one\n"
+		<< "  --watch             window only: reload edited shader files and the --scene file while running\n"
+		<< "  --extra-spheres <n> add n small diffuse spheres to the scene, e.g. to test large scenes\n"
+		<< "  --bench-tracers     time every gpu tracer pass headless at --width/--height/--samples and exit\n"
+		<< "  --bench-intersect   time the scalar and SIMD closest hit kernels and exit\n"
+		<< "  --shader-cache <dir>\n"
+		<< "                      directory for cached program binaries (default shader_cache), off to always compile\n"
+		<< "  --shader-compile <mode>\n"
+		<< "                      parallel (default, driver side with GL_KHR_parallel_shader_compile), thread\n"
+		<< "                      (worker thread with a shared context) or blocking; the window shows a preview\n"
+		<< "                      until the tracer is compiled\n"
+		<< "  --uber-shader       build the gpu tracers as one program for every scene instead of a variant\n"
+		<< "                      with the scene's exact primitive counts and material branches\n"
+		<< "  --max-bounce <n>    bounce limit of the gpu tracers (default 50, at most 1000)\n"
+		<< "  --bench-variants    time uber and scene specialized programs of every gpu tracer and exit\n"
+		<< "  --spp-per-pass <n>  paths per pixel each gpu tracer pass adds (default 1, at most 64)\n"
+		<< "  --frame-time <ms>   adapt the paths per pass to the GPU time of earlier passes (timer queries)\n"
+		<< "                      so a tracer pass takes about this long, e.g. 12 for a 60 Hz window\n"
+		<< "  --time-slice        window only: trace the image in --tile sized tiles (default 64), only as many\n"
+		<< "                      per frame as fit --frame-time (default 12 ms), to keep input responsive\n"
+		<< "  --converge <e>      stop tracing pixels once the standard error of their mean is below e times\n"
+		<< "                      the mean, e.g. 0.02 (fragment and compute tracers)\n"
+		<< "  --adaptive          hand out the samples of each pass per --tile sized tile (default 64) in\n"
+		<< "                      proportion to the tile's estimated error (fragment and compute tracers)\n"
+		<< "  --bench-adaptive    render uniform and adaptive sampling in the same time headless and print\n"
+		<< "                      their RMSE against --compare, then exit\n"
+		<< "  --tolerance <e>     headless gpu: trace until the estimated RMSE of the image relative to its mean\n"
+		<< "                      luminance is below e, e.g. 0.01, instead of a fixed --samples\n"
+		<< "  --time-budget <s>   headless gpu: stop tracing after s seconds, alone or with --tolerance\n"
+		<< "  --no-nee            do not sample the lights at diffuse hits (next event estimation); paths only\n"
+		<< "                      collect the sky they escape to, as the tracers originally did\n"
+		<< "  --bench-nee         trace headless to --tolerance (default 0.02) with and without next event\n"
+		<< "                      estimation, print the time and samples each took, then exit\n"
+		<< "  --compare <file>    print the RMSE of the headless render against a reference PPM\n"
+		<< "  --help              show this message" << std::endl;
+}
+
+// returns false if the program should exit (bad arguments or --help)
+inline bool parseOptions(int argc, char** argv, RenderOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--width" && hasValue) {
+			options.width = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--height" && hasValue) {
+			options.height = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--samples" && hasValue) {
+			options.samples = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--output" && hasValue) {
+			options.output = argv[++i];
+		}
+		else if (arg == "--renderer" && hasValue) {
+			std::string value = argv[++i];
+			if (value == "gpu") {
+				options.renderer = RendererType::GPU;
+			}
+			else if (value == "cpu") {
+				options.renderer = RendererType::CPU;
+			}
+			else {
+				std::cout << "unknown renderer: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--threads" && hasValue) {
+			options.threads = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--simd" && hasValue) {
+			std::string value = argv[++i];
+			if (value == "avx2") {
+				options.simd = SimdLevel::AVX2;
+			}
+			else if (value == "sse") {
+				options.simd = SimdLevel::SSE;
+			}
+			else if (value == "scalar") {
+				options.simd = SimdLevel::Scalar;
+			}
+			else {
+				std::cout << "unknown simd level: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--pin" && hasValue) {
+			std::string value = argv[++i];
+			if (value == "none") {
+				options.pinning = PinPolicy::None;
+			}
+			else if (value == "compact") {
+				options.pinning = PinPolicy::Compact;
+			}
+			else if (value == "scatter") {
+				options.pinning = PinPolicy::Scatter;
+			}
+			else {
+				std::cout << "unknown pinning policy: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--tracer" && hasValue) {
+			std::string value = argv[++i];
+			if (value == "fragment") {
+				options.tracer = TracerType::Fragment;
+			}
+			else if (value == "compute") {
+				options.tracer = TracerType::Compute;
+			}
+			else if (value == "wavefront") {
+				options.tracer = TracerType::Wavefront;
+			}
+			else if (value == "persistent") {
+				options.tracer = TracerType::Persistent;
+			}
+			else {
+				std::cout << "unknown tracer: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--workgroup" && hasValue) {
+			std::string value = argv[++i];
+			size_t x = value.find('x');
+			unsigned int sizeX = (unsigned int)std::strtoul(value.c_str(), NULL, 10);
+			unsigned int sizeY = x == std::string::npos ? 0 : (unsigned int)std::strtoul(value.c_str() + x + 1, NULL, 10);
+			if (sizeX == 0 || sizeY == 0) {
+				std::cout << "workgroup size must look like 16x16: " << value << std::endl;
+				return false;
+			}
+			options.workgroup = glm::uvec2(sizeX, sizeY);
+		}
+		else if (arg == "--tile" && hasValue) {
+			options.tileSize = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--worker-stats") {
+			options.workerStats = true;
+		}
+		else if (arg == "--packets") {
+			options.packets = true;
+		}
+		else if (arg == "--wavefront") {
+			options.wavefront = true;
+		}
+		else if (arg == "--persistent-groups" && hasValue) {
+			options.persistentGroups = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--scene" && hasValue) {
+			options.scene = argv[++i];
+		}
+		else if (arg == "--watch") {
+			options.watch = true;
+		}
+		else if (arg == "--extra-spheres" && hasValue) {
+			options.extraSpheres = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--bench-tracers") {
+			options.benchTracers = true;
+		}
+		else if (arg == "--bench-intersect") {
+			options.benchIntersect = true;
+		}
+		else if (arg == "--shader-cache" && hasValue) {
+			options.shaderCache = argv[++i];
+			if (options.shaderCache == "off") {
+				options.shaderCache.clear();
+			}
+		}
+		else if (arg == "--shader-compile" && hasValue) {
+			std::string value = argv[++i];
+			if (value == "parallel") {
+				options.shaderCompile = CompileMode::Parallel;
+			}
+			else if (value == "thread") {
+				options.shaderCompile = CompileMode::Thread;
+			}
+			else if (value == "blocking") {
+				options.shaderCompile = CompileMode::Blocking;
+			}
+			else {
+				std::cout << "unknown shader compile mode: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--uber-shader") {
+			options.uberShader = true;
+		}
+		else if (arg == "--max-bounce" && hasValue) {
+			options.maxBounce = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--bench-variants") {
+			options.benchVariants = true;
+		}
+		else if (arg == "--spp-per-pass" && hasValue) {
+			options.samplesPerPass = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+		}
+		else if (arg == "--frame-time" && hasValue) {
+			options.frameTime = std::atof(argv[++i]);
+		}
+		else if (arg == "--time-slice") {
+			options.timeSlice = true;
+		}
+		else if (arg == "--converge" && hasValue) {
+			options.converge = (float)std::atof(argv[++i]);
+		}
+		else if (arg == "--adaptive") {
+			options.adaptive = true;
+		}
+		else if (arg == "--bench-adaptive") {
+			options.benchAdaptive = true;
+		}
+		else if (arg == "--tolerance" && hasValue) {
+			options.tolerance = std::atof(argv[++i]);
+		}
+		else if (arg == "--time-budget" && hasValue) {
+			options.timeBudget = std::atof(argv[++i]);
+		}
+		else if (arg == "--no-nee") {
+			options.nextEvent = false;
+		}
+		else if (arg == "--bench-nee") {
+			options.benchNextEvent = true;
+		}
+		else if (arg == "--compare" && hasValue) {
+			options.compare = argv[++i];
+		}
+		else {
+			if (arg != "--help") {
+				std::cout << "unknown or incomplete option: " << arg << std::endl;
+			}
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	if (options.width == 0 || options.height == 0 || options.samples == 0 || options.maxBounce == 0 || options.samplesPerPass == 0) {
+		std::cout << "width, height, samples, max bounce and samples per pass must be positive" << std::endl;
+		return false;
+	}
+	if (options.samplesPerPass > SampleBatch::MAX_SAMPLES) {
+		std::cout << "samples per pass must be at most " << SampleBatch::MAX_SAMPLES << std::endl;
+		return false;
+	}
+	if (options.maxBounce > ShaderLibrary::MAX_BOUNCE_LIMIT) {
+		std::cout << "max bounce must be at most " << ShaderLibrary::MAX_BOUNCE_LIMIT << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#endif
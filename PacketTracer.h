@@ -0,0 +1,320 @@
+#ifndef PACKET_TRACER_H
+#define PACKET_TRACER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "CpuPathTracing.h"
+#include "SimdIntersect.h"
+
+// Traces an 8x8 block of pixels as one packet of 64 rays. Primary rays all lie on
+// lines through the camera position, so they are intersected from that shared
+// origin and shifted back by their distance to the image plane; primitives outside
+// the packet's frustum are skipped. Rays that hit a mirror stay in the packet,
+// rays that hit a diffuse surface leave it and finish as single rays.
+struct alignas(32) RayPacket {
+	static const unsigned int SIZE = 64;
+
+	float ox[SIZE], oy[SIZE], oz[SIZE];
+	float dx[SIZE], dy[SIZE], dz[SIZE];
+	float originOffset[SIZE];		//distance from the shared origin to the ray's own origin
+	float t[SIZE];
+	float primitive[SIZE];			//closest primitive as a float index, -1 for a miss
+	bool active[SIZE];
+	bool sharedOrigin = false;
+	glm::vec3 origin;
+
+	Ray ray(unsigned int i) const {
+		Ray r;
+		r.pos = glm::vec3(ox[i], oy[i], oz[i]);
+		r.dir = glm::vec3(dx[i], dy[i], dz[i]);
+		return r;
+	}
+
+	void setRay(unsigned int i, const Ray& r) {
+		ox[i] = r.pos.x; oy[i] = r.pos.y; oz[i] = r.pos.z;
+		dx[i] = r.dir.x; dy[i] = r.dir.y; dz[i] = r.dir.z;
+	}
+
+	// inactive lanes start at t = -1 so no primitive can ever be accepted for them
+	void resetHits() {
+		for (unsigned int i = 0; i < SIZE; i++) {
+			t[i] = active[i] ? 1e30f : -1.0f;
+			primitive[i] = -1.0f;
+		}
+	}
+};
+
+// Four planes through the shared origin bounding every ray of a primary packet.
+struct PacketFrustum {
+	glm::vec3 normals[4];
+
+	PacketFrustum(const RayPacket& packet, const glm::mat4& view) {
+		glm::mat3 toCamera(view);
+		glm::mat3 toWorld = glm::transpose(toCamera);
+		float uMin = 1e30f, uMax = -1e30f, vMin = 1e30f, vMax = -1e30f;
+		for (unsigned int i = 0; i < RayPacket::SIZE; i++) {
+			if (!packet.active[i]) {
+				continue;
+			}
+			glm::vec3 d = toCamera * glm::vec3(packet.dx[i], packet.dy[i], packet.dz[i]);
+			float u = d.x / -d.z;
+			float v = d.y / -d.z;
+			uMin = std::min(uMin, u); uMax = std::max(uMax, u);
+			vMin = std::min(vMin, v); vMax = std::max(vMax, v);
+		}
+		normals[0] = toWorld * glm::vec3(1.0f, 0.0f, uMin);
+		normals[1] = toWorld * glm::vec3(-1.0f, 0.0f, -uMax);
+		normals[2] = toWorld * glm::vec3(0.0f, 1.0f, vMin);
+		normals[3] = toWorld * glm::vec3(0.0f, -1.0f, -vMax);
+		for (glm::vec3& n : normals) {
+			n = glm::normalize(n);
+		}
+	}
+
+	bool culls(const glm::vec3& origin, const glm::vec3& center, float radius) const {
+		for (const glm::vec3& n : normals) {
+			if (glm::dot(center - origin, n) < -radius) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 inline void intersectPacketSpheresAVX2(const SceneSoA& soa, const std::vector<unsigned int>& spheres, RayPacket& packet) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	for (unsigned int s : spheres) {
+		const __m256 index = _mm256_set1_ps((float)s);
+		const __m256 r = _mm256_set1_ps(soa.sphereRadius[s]);
+		const __m256 cx = _mm256_set1_ps(soa.sphereX[s]), cy = _mm256_set1_ps(soa.sphereY[s]), cz = _mm256_set1_ps(soa.sphereZ[s]);
+		//with a shared origin the offset to the center and c are the same for every ray
+		glm::vec3 sharedTmp = packet.origin - glm::vec3(soa.sphereX[s], soa.sphereY[s], soa.sphereZ[s]);
+		const __m256 stx = _mm256_set1_ps(sharedTmp.x), sty = _mm256_set1_ps(sharedTmp.y), stz = _mm256_set1_ps(sharedTmp.z);
+		const __m256 sharedC = _mm256_set1_ps(glm::dot(sharedTmp, sharedTmp) - soa.sphereRadius[s] * soa.sphereRadius[s]);
+		for (unsigned int i = 0; i < RayPacket::SIZE; i += 8) {
+			__m256 dx = _mm256_load_ps(&packet.dx[i]), dy = _mm256_load_ps(&packet.dy[i]), dz = _mm256_load_ps(&packet.dz[i]);
+			__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			__m256 bestT = _mm256_load_ps(&packet.t[i]);
+			__m256 t;
+			__m256 valid;
+			if (packet.sharedOrigin) {
+				__m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, stx), _mm256_mul_ps(dy, sty)), _mm256_mul_ps(dz, stz)));
+				__m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(four, a), sharedC));
+				__m256 root = _mm256_sqrt_ps(_mm256_max_ps(delta, zero));
+				__m256 tNear = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(root, signMask), b), two), a);
+				__m256 tFar = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(root, b), two), a);
+				//the far root is used when the ray's own origin lies between the two roots, i.e. inside the sphere
+				__m256 offset = _mm256_load_ps(&packet.originOffset[i]);
+				t = _mm256_sub_ps(_mm256_blendv_ps(tFar, tNear, _mm256_cmp_ps(tNear, offset, _CMP_GE_OQ)), offset);
+				valid = _mm256_cmp_ps(delta, zero, _CMP_GE_OQ);
+			}
+			else {
+				__m256 tx = _mm256_sub_ps(_mm256_load_ps(&packet.ox[i]), cx);
+				__m256 ty = _mm256_sub_ps(_mm256_load_ps(&packet.oy[i]), cy);
+				__m256 tz = _mm256_sub_ps(_mm256_load_ps(&packet.oz[i]), cz);
+				__m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, tx), _mm256_mul_ps(dy, ty)), _mm256_mul_ps(dz, tz)));
+				__m256 tmp2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz));
+				__m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(four, a), _mm256_sub_ps(tmp2, _mm256_mul_ps(r, r))));
+				__m256 root = _mm256_sqrt_ps(_mm256_max_ps(delta, zero));
+				__m256 inside = _mm256_cmp_ps(_mm256_sqrt_ps(tmp2), r, _CMP_LT_OQ);
+				root = _mm256_xor_ps(root, _mm256_andnot_ps(inside, signMask));
+				t = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(root, b), two), a);
+				valid = _mm256_cmp_ps(delta, zero, _CMP_GE_OQ);
+			}
+			__m256 mask = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+			_mm256_store_ps(&packet.t[i], _mm256_blendv_ps(bestT, t, mask));
+			_mm256_store_ps(&packet.primitive[i], _mm256_blendv_ps(_mm256_load_ps(&packet.primitive[i]), index, mask));
+		}
+	}
+}
+
+SIMD_TARGET_AVX2 inline void intersectPacketPlanesAVX2(const SceneSoA& soa, const std::vector<unsigned int>& planes, RayPacket& packet) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	for (unsigned int p : planes) {
+		const __m256 index = _mm256_set1_ps((float)(soa.sphereCount + p));
+		const __m256 nx = _mm256_set1_ps(soa.planeNX[p]), ny = _mm256_set1_ps(soa.planeNY[p]), nz = _mm256_set1_ps(soa.planeNZ[p]);
+		const __m256 px = _mm256_set1_ps(soa.planePX[p]), py = _mm256_set1_ps(soa.planePY[p]), pz = _mm256_set1_ps(soa.planePZ[p]);
+		const __m256 len = _mm256_set1_ps(soa.planeLength[p]);
+		const __m256 offset = _mm256_set1_ps(soa.planeOffset[p]);
+		const __m256 sharedNumerator = _mm256_set1_ps(soa.planeOffset[p] -
+			(packet.origin.x * soa.planeNX[p] + packet.origin.y * soa.planeNY[p] + packet.origin.z * soa.planeNZ[p]));
+		const __m256 sx = _mm256_set1_ps(packet.origin.x), sy = _mm256_set1_ps(packet.origin.y), sz = _mm256_set1_ps(packet.origin.z);
+		for (unsigned int i = 0; i < RayPacket::SIZE; i += 8) {
+			__m256 dx = _mm256_load_ps(&packet.dx[i]), dy = _mm256_load_ps(&packet.dy[i]), dz = _mm256_load_ps(&packet.dz[i]);
+			__m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+			__m256 ox, oy, oz, t, tOrigin;
+			if (packet.sharedOrigin) {
+				ox = sx; oy = sy; oz = sz;
+				tOrigin = _mm256_div_ps(sharedNumerator, denominator);
+				t = _mm256_sub_ps(tOrigin, _mm256_load_ps(&packet.originOffset[i]));
+			}
+			else {
+				ox = _mm256_load_ps(&packet.ox[i]); oy = _mm256_load_ps(&packet.oy[i]); oz = _mm256_load_ps(&packet.oz[i]);
+				__m256 originDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, nx), _mm256_mul_ps(oy, ny)), _mm256_mul_ps(oz, nz));
+				tOrigin = _mm256_div_ps(_mm256_sub_ps(offset, originDistance), denominator);
+				t = tOrigin;
+			}
+			__m256 ex = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(ox, _mm256_mul_ps(tOrigin, dx)), px));
+			__m256 ey = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oy, _mm256_mul_ps(tOrigin, dy)), py));
+			__m256 ez = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oz, _mm256_mul_ps(tOrigin, dz)), pz));
+			__m256 bestT = _mm256_load_ps(&packet.t[i]);
+			__m256 mask = _mm256_and_ps(_mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ),
+				_mm256_and_ps(_mm256_cmp_ps(ex, len, _CMP_LT_OQ), _mm256_and_ps(_mm256_cmp_ps(ey, len, _CMP_LT_OQ), _mm256_cmp_ps(ez, len, _CMP_LT_OQ))));
+			mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+			_mm256_store_ps(&packet.t[i], _mm256_blendv_ps(bestT, t, mask));
+			_mm256_store_ps(&packet.primitive[i], _mm256_blendv_ps(_mm256_load_ps(&packet.primitive[i]), index, mask));
+		}
+	}
+}
+#endif
+
+class PacketTracer {
+public:
+	static const unsigned int PACKET_SIZE = 8;		//pixels per side of a packet
+
+	PacketTracer(const Scene& scene, const SimdIntersector& intersector) :
+		scene(scene),
+		intersector(intersector),
+		soa(scene)
+	{
+		available = detectSimdLevel() == SimdLevel::AVX2 && intersector.simdLevel() == SimdLevel::AVX2;
+		sphereBounds.reserve(scene.spheres.size());
+		for (const Sphere& sphere : scene.spheres) {
+			sphereBounds.push_back(sphere.radius);
+		}
+		for (const Plane& plane : scene.planes) {
+			//the accepted region of a plane is a square inside a cube of half size lenght
+			planeBounds.push_back(plane.lenght * std::sqrt(3.0f));
+		}
+	}
+
+	// packets need the AVX2 kernels; otherwise the caller traces single rays
+	bool isAvailable() const {
+		return available;
+	}
+
+	// sample the lights at diffuse hits, see tracePath
+	void setNextEventEnabled(bool enabled) {
+		nextEvent = enabled;
+	}
+
+	// traces one sample for the pixels [x0, x1) x [y0, y1), at most 8x8, adding to accumulation
+	void traceBlock(const PrimaryRayParams& params, const glm::mat4& view, const glm::vec2& randomVector,
+		unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, glm::vec3* accumulation, unsigned int stride) const
+	{
+		RayPacket packet;
+		ShaderRandom random[RayPacket::SIZE];
+		glm::vec3 color[RayPacket::SIZE];
+		unsigned int pixelIndex[RayPacket::SIZE];
+
+		packet.sharedOrigin = true;
+		packet.origin = params.cameraPos;
+		for (unsigned int i = 0; i < RayPacket::SIZE; i++) {
+			unsigned int x = x0 + i % PACKET_SIZE;
+			unsigned int y = y0 + i / PACKET_SIZE;
+			packet.active[i] = x < x1 && y < y1;
+			if (!packet.active[i]) {
+				packet.setRay(i, { params.cameraPos, glm::vec3(0.0f, 0.0f, -1.0f) });
+				packet.originOffset[i] = 0.0f;
+				continue;
+			}
+			glm::vec2 fragCoord(x + 0.5f, y + 0.5f);
+			random[i] = { fragCoord, randomVector };
+			Ray ray = generatePrimaryRay(params, params.pixelPos(fragCoord.x, fragCoord.y), random[i]);
+			packet.setRay(i, ray);
+			packet.originOffset[i] = glm::length(ray.pos - params.cameraPos);
+			color[i] = glm::vec3(1.0f);
+			pixelIndex[i] = y * stride + x;
+		}
+
+		PacketFrustum frustum(packet, view);
+		std::vector<unsigned int> spheres, planes;
+		for (unsigned int s = 0; s < scene.spheres.size(); s++) {
+			if (!frustum.culls(params.cameraPos, scene.spheres[s].center, sphereBounds[s])) {
+				spheres.push_back(s);
+			}
+		}
+		for (unsigned int p = 0; p < scene.planes.size(); p++) {
+			if (!frustum.culls(params.cameraPos, scene.planes[p].position, planeBounds[p])) {
+				planes.push_back(p);
+			}
+		}
+
+		for (int bounce = 0; bounce < CPU_MAX_BOUNCE; bounce++) {
+			bool anyActive = false;
+			packet.resetHits();
+#ifdef SIMD_X86
+			intersectPacketSpheresAVX2(soa, spheres, packet);
+			intersectPacketPlanesAVX2(soa, planes, packet);
+#endif
+			for (unsigned int i = 0; i < RayPacket::SIZE; i++) {
+				if (!packet.active[i]) {
+					continue;
+				}
+				Ray ray = packet.ray(i);
+				ClosestHit closest;
+				closest.t = packet.t[i];
+				closest.primitive = (int)packet.primitive[i];
+				HitInfo hit;
+				if (!intersector.resolve(ray, closest, hit)) {
+					accumulation[pixelIndex[i]] += color[i] * skyColor(ray.dir);
+					packet.active[i] = false;
+					continue;
+				}
+				color[i] *= hit.mtl->attenuation;
+				glm::vec3 radiance = nextEvent && hit.mtl->diffuse ? color[i] * sampleLights(intersector, scene.lights, hit) : glm::vec3(0.0f);
+				Ray scatter;
+				if (!computeScatterRay(hit, ray, random[i], scatter, nextEvent)) {
+					packet.active[i] = false;
+					continue;
+				}
+				if (hit.mtl->diffuse) {
+					//diffuse bounces are incoherent: finish this path on its own
+					accumulation[pixelIndex[i]] += tracePath(intersector, scatter, random[i], nextEvent ? &scene.lights : nullptr,
+						bounce + 1, color[i], radiance);
+					packet.active[i] = false;
+					continue;
+				}
+				packet.setRay(i, scatter);
+				anyActive = true;
+			}
+			if (!anyActive) {
+				return;
+			}
+			//reflected rays no longer share an origin, and may go anywhere
+			if (packet.sharedOrigin) {
+				packet.sharedOrigin = false;
+				spheres.resize(scene.spheres.size());
+				planes.resize(scene.planes.size());
+				for (unsigned int s = 0; s < spheres.size(); s++) {
+					spheres[s] = s;
+				}
+				for (unsigned int p = 0; p < planes.size(); p++) {
+					planes[p] = p;
+				}
+			}
+		}
+		//paths still in the packet ran out of bounces and stay black
+	}
+
+private:
+	const Scene& scene;
+	const SimdIntersector& intersector;
+	SceneSoA soa;
+	std::vector<float> sphereBounds;
+	std::vector<float> planeBounds;
+	bool available = false;
+	bool nextEvent = false;
+};
+
+#endif
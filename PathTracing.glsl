@@ -0,0 +1,348 @@
+// Shared by the tracer passes (FragmentShader.fs, PathTracer.comp, Wavefront.comp): scene
+// description, intersection, scattering and the bounce loop. Included through
+// Shader::loadSource, the defines can be overridden by the program's define prelude.
+// The scene lives in the std430 buffers SceneBuffers binds at 4-7; the
+// element counts come from their lengths.
+// A scene variant (ShaderLibrary::variantDefines) sets NUM_SPHERES, NUM_PLANES and
+// NUM_LIGHTS to the exact counts and HAS_DIFFUSE/HAS_METALLIC to 0 for material
+// kinds the scene does not use, which removes their branches.
+// NEXT_EVENT 1 samples the point lights at every diffuse hit (SampleLights) and
+// scatters diffuse rays by the cosine; 0 is the original estimator, where a path
+// only picks up the sky it happens to escape to and the point lights are never seen.
+#ifndef MAX_BOUNCE
+#define MAX_BOUNCE 50
+#endif
+#ifndef NEXT_EVENT
+#define NEXT_EVENT 1
+#endif
+#ifndef HAS_DIFFUSE
+#define HAS_DIFFUSE 1
+#endif
+#ifndef HAS_METALLIC
+#define HAS_METALLIC 1
+#endif
+#define PI        3.14159265358979323
+
+struct Ray{
+	vec3 pos;
+	vec3 dir;
+};
+
+struct Material{
+	vec3 attenuation;
+	bool diffuse;
+	bool metallic;
+};
+
+struct HitInfo{
+	float t;
+	vec3 position;
+	vec3 normal;
+	Material mtl;
+	bool frontFace;
+	int primitive;		//spheres first, then planes at SPHERE_COUNT + i
+};
+
+struct Sphere{
+	vec3 center;
+	float radius;
+	uint material;		//index into materials
+	uint occluder;		//the sphere Occluded tests k-th, largest first
+};
+
+struct Plane{
+	vec3 normal;
+	float lenght;
+	vec3 position;
+	uint material;
+	uint occluder;		//the plane Occluded tests k-th, largest first
+};
+
+struct Light{
+	vec3 position;
+	vec3 intensity;
+};
+
+layout(std430, binding = 4) readonly buffer Materials{
+	Material materials[];
+};
+layout(std430, binding = 5) readonly buffer Spheres{
+	Sphere spheres[];
+};
+layout(std430, binding = 6) readonly buffer Planes{
+	Plane planes[];
+};
+layout(std430, binding = 7) readonly buffer Lights{
+	Light lights[];
+};
+
+#ifdef NUM_SPHERES
+#define SPHERE_COUNT NUM_SPHERES
+#else
+#define SPHERE_COUNT spheres.length()
+#endif
+#ifdef NUM_PLANES
+#define PLANE_COUNT NUM_PLANES
+#else
+#define PLANE_COUNT planes.length()
+#endif
+#ifdef NUM_LIGHTS
+#define LIGHT_COUNT NUM_LIGHTS
+#else
+#define LIGHT_COUNT lights.length()
+#endif
+#include "FrameData.glsl"
+#include "Statistics.glsl"
+
+uniform float view_pixel_width;		//width of viewport pixel
+uniform float view_pixel_height;		
+
+Ray GeneratePrimaryRay(vec3 pixelPos);
+Ray ComputeScatterRay(HitInfo hit, Ray incidentRay);
+bool IntersectRay(inout HitInfo hit,Ray ray);
+bool Occluded(Ray ray, float tMax);
+vec3 Shade(vec3 position, vec3 normal, vec3 view, Material mtl);
+float rand( );
+vec3 TracePath(Ray ray);
+vec3 SkyColor(vec3 dir);
+vec3 SampleLights(HitInfo hit);
+
+vec2 seed;
+vec3 errorRay = vec3(2,2,2);
+
+uniform uint width;
+uniform uint height;
+
+// one path from the primary ray; returns the light it carries to the camera
+vec3 TracePath(Ray ray){
+	vec3 throughput = vec3(1.0f,1.0f,1.0f);
+	vec3 radiance = vec3(0.0f);
+
+	for(int j = 0 ; j < MAX_BOUNCE ; j++){
+		HitInfo hit;
+		if(!IntersectRay(hit, ray)){
+			return radiance + throughput * SkyColor(ray.dir);
+		}
+		throughput *= hit.mtl.attenuation;
+#if NEXT_EVENT && HAS_DIFFUSE
+		if(hit.mtl.diffuse){
+			radiance += throughput * SampleLights(hit);
+		}
+#endif
+		ray = ComputeScatterRay(hit, ray);
+		if(ray.dir == errorRay){
+			//material is not defined
+			return vec3(0);
+		}
+	}
+	//no light path toward the light source with the given depth; the light
+	//sampled on the way is kept
+	return radiance;
+}
+
+vec3 SkyColor(vec3 dir){
+	float t = 0.5*(dir.y + 1.0);
+	return (1.0-t)*vec3(1.0, 1.0, 1.0) + t*vec3(0.5, 0.7, 1.0);
+}
+
+// direction around normal with a pdf of cos/PI, the Lambertian lobe
+vec3 CosineDirection(vec3 normal){
+	float phi = 2*PI*rand();
+	float r2 = rand();
+	vec3 tangent = normalize(abs(normal.x) > 0.5f ? cross(normal, vec3(0, 1, 0)) : cross(normal, vec3(1, 0, 0)));
+	vec3 bitangent = cross(normal, tangent);
+	return normalize(sqrt(r2) * (cos(phi) * tangent + sin(phi) * bitangent) + sqrt(1.0f - r2) * normal);
+}
+
+#if NEXT_EVENT
+// Next event estimation at a diffuse hit: the light of the point lights reaching
+// it directly, per unit of the material's attenuation. A path never hits a point
+// light by chance, so each one gets a shadow ray and adds intensity * cos/PI /
+// distance^2. The sky needs no ray of its own: the cosine distributed scatter ray
+// is its shadow ray, and an escaping one carries the sky color with a weight of
+// exactly 1 (cos/PI over its pdf). A separate sky ray is independent of where the
+// path goes next, so it adds noise instead of removing it.
+vec3 SampleLights(HitInfo hit){
+	vec3 origin = hit.position + 1e-3 * hit.normal;
+	vec3 light = vec3(0);
+	Ray shadow;
+	shadow.pos = origin;
+	for(int i = 0 ; i < LIGHT_COUNT ; i++){
+		vec3 toLight = lights[i].position - origin;
+		float distance2 = dot(toLight, toLight);
+		float distance = sqrt(distance2);
+		shadow.dir = toLight / distance;
+		float cosine = dot(hit.normal, shadow.dir);
+		if(cosine > 0.0f && !Occluded(shadow, distance)){
+			light += lights[i].intensity * cosine / (PI * distance2);
+		}
+	}
+	return light;
+}
+#endif
+
+// rand() state of sample s of a pixel. Sample 0 starts at the pixel center like a
+// single sample per pass always did; the others are moved along an irrational
+// direction so no two samples of one pass, or of neighbouring pixels, share a sequence.
+vec2 SampleSeed(vec2 fragCoord, uint s){
+	return fragCoord + float(s) * vec2(0.7548777, 0.5698403);
+}
+
+// sum of samplesPerPixel paths through the pixel at fragCoord, and the sum of their
+// squared luminances for the pixel's variance
+vec3 TracePixel(vec2 fragCoord, vec3 pixelPos, out float luminanceSquares){
+	vec3 color = vec3(0);
+	luminanceSquares = 0.0f;
+	for(uint s = 0; s < samplesPerPixel; s++){
+		seed = SampleSeed(fragCoord, s);
+		vec3 sampleColor = TracePath(GeneratePrimaryRay(pixelPos));
+		color += sampleColor;
+		luminanceSquares += Luminance(sampleColor) * Luminance(sampleColor);
+	}
+	return color;
+}
+
+Ray ComputeScatterRay(HitInfo hit, Ray incidentRay)
+{
+	Ray scatter;
+	scatter.pos = hit.position + 1e-3 * hit.normal;
+
+#if HAS_DIFFUSE && NEXT_EVENT
+	if(hit.mtl.diffuse){
+		scatter.dir = CosineDirection(hit.normal);
+		return scatter;
+	}
+#elif HAS_DIFFUSE
+	if(hit.mtl.diffuse){												
+		float y =  rand() * 2.0 -1.0;
+		float phi = 2*PI*rand();
+		float x = sqrt(1-y*y)*cos(phi);
+		float z = sqrt(1-y*y)*sin(phi);
+		vec3 target = normalize(vec3 (x,y,z));
+		if(dot(target,hit.normal) < 0.0f){
+			target = -target;
+		}
+		//target = scatter.pos + target;
+		//scatter.dir = normalize(target - scatter.pos);
+		scatter.dir = normalize(target);
+		return scatter;
+	}
+#endif
+#if HAS_METALLIC
+	if(hit.mtl.metallic){
+		scatter.dir = 2*dot(-incidentRay.dir,hit.normal)*hit.normal + incidentRay.dir;	//perfect reflection direction
+		return scatter;
+	}
+#endif
+	scatter.dir = errorRay;
+	return scatter;
+
+}
+
+bool IntersectRay(inout HitInfo hit,Ray ray){
+	hit.t = 1e30;
+	bool foundHit = false;
+	for(int i = 0 ; i < SPHERE_COUNT ; i++){									//spheres 
+		vec3 center = spheres[i].center;
+		vec3 tmp = ray.pos - center;
+		float a = dot(ray.dir, ray.dir);
+		float b = 2 * dot(ray.dir,tmp);
+		float c = dot(tmp, tmp) - spheres[i].radius*spheres[i].radius;
+		float delta = b*b - 4*a*c;
+		if(delta >= 0.0f){
+			float t;
+			if(length(ray.pos - center) < spheres[i].radius){				//ray origin is inside the sphere																	
+				t = (-b + sqrt(delta))/ 2.0 * a; 
+			}
+			else{
+				t = (-b - sqrt(delta))/ 2.0 * a; 
+			}
+			if( t < hit.t && t > 0.0f){
+				hit.t = t;
+				hit.position = ray.pos + t*ray.dir;
+				hit.normal = normalize(hit.position - center);
+				hit.frontFace = dot(ray.dir,hit.normal) < 0.0f;
+				hit.normal = hit.frontFace ? hit.normal : -hit.normal;
+				hit.mtl = materials[spheres[i].material];
+				hit.primitive = i;
+				foundHit = true;
+			}
+		}
+	}
+	for(int i = 0 ; i < PLANE_COUNT ; i++){									//plane count
+		float denominator = dot(ray.dir, planes[i].normal);
+		if(denominator != 0.0f){											//plane and ray are not perpendicular			
+			float c = dot(planes[i].normal, planes[i].position);
+			float t = (c - dot(ray.pos, planes[i].normal)) / denominator;
+			vec3 positionOnPlane = ray.pos + t*ray.dir;
+			vec3 distance = positionOnPlane - planes[i].position;
+			if(abs(distance.x) < planes[i].lenght && abs(distance.y) < planes[i].lenght && abs(distance.z) < planes[i].lenght){
+				if( t < hit.t && t > 0.0f ){
+					hit.t = t;
+					hit.position = positionOnPlane;
+					hit.normal = planes[i].normal;
+					hit.frontFace = dot(ray.dir,planes[i].normal) < 0.0f;
+					hit.normal = hit.frontFace ? hit.normal : -hit.normal;
+					hit.mtl = materials[planes[i].material];
+					hit.primitive = SPHERE_COUNT + i;
+					foundHit = true;
+				}
+			}
+		}
+	}
+	return foundHit;
+}
+
+// Any hit query for shadow rays: whether anything lies on the ray closer than tMax.
+// Same tests as IntersectRay, but it returns at the first blocker and never reads
+// a material or builds a hit. Planes, the floors and walls, go before the spheres,
+// and each kind goes largest first as the occluder members list them.
+bool Occluded(Ray ray, float tMax){
+	for(int k = 0 ; k < PLANE_COUNT ; k++){
+		int i = int(planes[k].occluder);
+		float denominator = dot(ray.dir, planes[i].normal);
+		if(denominator != 0.0f){
+			float c = dot(planes[i].normal, planes[i].position);
+			float t = (c - dot(ray.pos, planes[i].normal)) / denominator;
+			vec3 distance = ray.pos + t*ray.dir - planes[i].position;
+			if(t > 0.0f && t < tMax && abs(distance.x) < planes[i].lenght && abs(distance.y) < planes[i].lenght && abs(distance.z) < planes[i].lenght){
+				return true;
+			}
+		}
+	}
+	for(int k = 0 ; k < SPHERE_COUNT ; k++){
+		int i = int(spheres[k].occluder);
+		vec3 tmp = ray.pos - spheres[i].center;
+		float a = dot(ray.dir, ray.dir);
+		float b = 2 * dot(ray.dir,tmp);
+		float c = dot(tmp, tmp) - spheres[i].radius*spheres[i].radius;
+		float delta = b*b - 4*a*c;
+		if(delta >= 0.0f){
+			float root = length(tmp) < spheres[i].radius ? sqrt(delta) : -sqrt(delta);
+			float t = (-b + root)/ 2.0 * a;
+			if(t > 0.0f && t < tMax){
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+Ray GeneratePrimaryRay(vec3 pixelPos){
+	float n = rand();													//0, 1
+	float y = view_pixel_width * (n-1) + 0.5f*view_pixel_width	;			// -1/2*view_pixel_width , 1/2*view_pixel_width
+	float offsetX = y;
+	n = rand();															//0, 1
+	y = view_pixel_height * (n-1) + 0.5f*view_pixel_height	;				// -1/2*view_pixel_width , 1/2*view_pixel_width
+	float offsetY = y;
+
+	Ray ray;
+	ray.pos = pixelPos + vec3(offsetX, offsetY, 0.0f);
+	ray.dir = normalize(ray.pos - cameraPos);
+	return ray;
+}
+
+float rand(){
+	seed-=randomVector;
+	return fract(sin(dot(seed.xy ,vec2(12.9898,78.233))) * 43758.5453);
+}
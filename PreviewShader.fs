@@ -0,0 +1,27 @@
+#version 450 core
+// Shown while the tracer programs are still compiling: the primary ray through
+// the pixel center, the first hit colored by its material and the angle to the
+// camera, the sky on a miss. No bounces and no accumulation.
+
+out vec4 FragColor;
+in vec3 pixelPos;
+
+#include "PathTracing.glsl"
+
+void main(){
+	Ray ray;
+	ray.pos = pixelPos;
+	ray.dir = normalize(pixelPos - cameraPos);
+
+	vec3 color;
+	HitInfo hit;
+	if(IntersectRay(hit, ray)){
+		color = hit.mtl.attenuation * (0.2f + 0.8f * max(dot(hit.normal, -ray.dir), 0.0f));
+	}
+	else{
+		//sky color
+		float t = 0.5*(ray.dir.y + 1.0);
+		color = (1.0-t)*vec3(1.0, 1.0, 1.0) + t*vec3(0.5, 0.7, 1.0);
+	}
+	FragColor = vec4(color, 1);
+}
@@ -0,0 +1,555 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "Scene.h"
+#include "SceneBuffers.h"
+#include "GpuWavefront.h"
+#include "FrameUniforms.h"
+#include "ShaderLibrary.h"
+#include "TileProgress.h"
+#include "ConvergenceMask.h"
+#include "AdaptiveSampler.h"
+#include "TileStatistics.h"
+
+// How the tracer pass runs:
+// Fragment  FragmentShader.fs drawn over the image quad, added into the accumulation
+//           framebuffer with additive blending
+// Compute   PathTracer.comp dispatched over tiles of the image, adding into the
+//           accumulation texture with imageLoad/imageStore
+// Wavefront GpuWavefront: generate, intersect, shade and compact dispatches with
+//           ray queues in SSBOs, one round per bounce
+// Persistent PersistentTracer.comp: a fixed number of workgroups whose invocations
+//           pull pixels from a global atomic counter until the frame is done
+enum class TracerType { Fragment, Compute, Wavefront, Persistent };
+
+// Owns the two GPU passes: the tracer pass that adds paths to the
+// accumulation texture and the view pass that divides it by the sample count.
+// Every tracer keeps the pixel's sample count in the accumulation's alpha and
+// the sum of squared luminances in a second texture (Statistics.glsl), so pixels
+// can have different counts (time slicing, convergence mask, adaptive sampling).
+class Renderer {
+public:
+	unsigned int width;
+	unsigned int height;
+
+	// workgroup is the compute workgroup size (e.g. 8x8, 16x16, 32x4); ignored by the fragment tracer.
+	// The persistent tracer uses workgroup.x * workgroup.y invocations per group.
+	// The tracer programs come from the library as the variant for this scene (its own
+	// blocking, specialized library if none is given). With an asynchronous compiler
+	// they may still be building when the constructor returns; see isReady.
+	Renderer(unsigned int width, unsigned int height, float fov, const Scene& scene,
+		TracerType tracer = TracerType::Fragment, glm::uvec2 workgroup = glm::uvec2(8, 8), ShaderLibrary* library = nullptr) :
+		width(width),
+		height(height),
+		fov(fov),
+		tracer(tracer),
+		workgroup(workgroup),
+		ownLibrary(library ? nullptr : new ShaderLibrary()),
+		shaders(library ? *library : *ownLibrary),
+		variantDefines(shaders.variantDefines(scene)),
+		tracerShader(createTracerShader(tracer, workgroup, shaders, variantDefines)),
+		viewShader(shaders.program("VertexShader.vs", "ViewFragmentShader.fs", "")),
+		sceneBuffers(scene)
+	{
+		float aspectRatio = (float)width / (float)height;
+		float ff = tan(glm::radians(fov * 0.5f));
+		float vertices[] = {
+			-aspectRatio*ff,  ff, -1.0,
+			 aspectRatio*ff,  ff, -1.0,
+			 aspectRatio*ff, -ff, -1.0,
+			-aspectRatio*ff, -ff, -1.0
+		};
+		int indices[] = {
+			0, 1, 2,
+			0, 2, 3
+		};
+
+		if (tracer == TracerType::Wavefront) {
+			wavefront.reset(new GpuWavefront(width, height, fov, frameUniforms, shaders, variantDefines));
+		}
+		if (tracer == TracerType::Persistent) {
+			glGenBuffers(1, &workCounter);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, workCounter);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		createFrameBuffer();
+		isReady();
+	}
+
+	~Renderer() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &workCounter);
+		glDeleteTextures(1, &renderedTexture);
+		glDeleteTextures(1, &squaresTexture);
+		glDeleteFramebuffers(1, &frameBuffer);
+	}
+
+	bool isComplete() const {
+		return frameBufferComplete;
+	}
+
+	TracerType tracerType() const {
+		return tracer;
+	}
+
+	// true once the tracer and view programs are built; sets their uniforms the first
+	// time. Never blocks.
+	bool isReady() {
+		if (tracerReady) {
+			return true;
+		}
+		bool viewReady = viewShader->isReady();
+		bool ready = tracer == TracerType::Wavefront ? wavefront->isReady() : tracerShader->isReady();
+		if (convergence) {
+			ready = convergence->isReady(projection()) && ready;
+			ready = (!listTracerShader || listTracerShader->isReady()) && ready;
+		}
+		if (!ready || !viewReady) {
+			return false;
+		}
+		viewShader->use();
+		viewShader->setMat4("proj", projection());
+		viewShader->setUInt("width", width);
+		viewShader->setUInt("height", height);
+		frameUniforms.attach(*viewShader);
+		if (tracer == TracerType::Wavefront) {
+			tracerReady = true;
+			return true;
+		}
+		tracerShader->use();
+		tracerShader->setMat4("proj", projection());
+		setImageUniforms(*tracerShader, width, height, fov);
+		frameUniforms.attach(*tracerShader);
+		tileOffsetLocation = tracerShader->uniformLocation("tileOffset");
+		tileEndLocation = tracerShader->uniformLocation("tileEnd");
+		if (listTracerShader) {
+			setImageUniforms(*listTracerShader, width, height, fov);
+			frameUniforms.attach(*listTracerShader);
+		}
+		tracerReady = true;
+		return true;
+	}
+
+	// Stops tracing pixels whose relative standard error fell below threshold, see
+	// ConvergenceMask; 0 traces every pixel again. Only the fragment and compute
+	// tracers can skip pixels, and time sliced or adaptive tiles ignore the mask.
+	// Returns false if the tracer cannot use a mask.
+	bool setConvergence(float threshold) {
+		convergence.reset();
+		listTracerShader.reset();
+		tracerReady = false;
+		if (threshold <= 0.0f) {
+			return true;
+		}
+		if (tracer != TracerType::Fragment && tracer != TracerType::Compute) {
+			return false;
+		}
+		if (tracer == TracerType::Compute) {
+			listTracerShader = shaders.compute("PathTracer.comp", "#define PIXEL_LIST\n" + computeDefines(workgroup) + variantDefines);
+		}
+		convergence.reset(new ConvergenceMask(tracer == TracerType::Fragment, width, height, threshold, workgroup.x * workgroup.y,
+			frameBuffer, renderedTexture, squaresTexture, frameUniforms, shaders));
+		return convergence->isComplete();
+	}
+
+	// the accumulation texture as floats, rgba per pixel with the sample count in
+	// alpha, rows from the bottom
+	std::vector<float> readAccumulation() const {
+		std::vector<float> rgba((size_t)width * height * 4);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glGetTextureImage(renderedTexture, 0, GL_RGBA, GL_FLOAT, (GLsizei)(rgba.size() * sizeof(float)), rgba.data());
+		return rgba;
+	}
+
+	// reads the per tile sums of this renderer's accumulation into statistics, e.g.
+	// for its relativeError(); waits for the GPU
+	void readStatistics(TileStatistics& statistics) const {
+		statistics.read(renderedTexture, squaresTexture);
+	}
+
+	// The library swapped in rebuilt programs (ShaderLibrary::update); their uniforms
+	// are set again by the next isReady.
+	void programsReloaded() {
+		tracerReady = false;
+		previewConfigured = false;
+		if (wavefront) {
+			wavefront->programsReloaded();
+		}
+		if (convergence) {
+			convergence->programsReloaded();
+		}
+	}
+
+	// Applies an edited scene to the scene buffers in place. If its primitive counts
+	// or material kinds changed, the tracer switches to the variant for the new scene,
+	// which may have to compile first (isReady). Returns false if the scene did not
+	// change, so the accumulated samples are still valid.
+	bool updateScene(const Scene& scene) {
+		if (sceneBuffers.update(scene) == SceneBuffers::Change::None) {
+			return false;
+		}
+		std::string defines = shaders.variantDefines(scene);
+		if (defines != variantDefines) {
+			variantDefines = defines;
+			if (tracer == TracerType::Wavefront) {
+				wavefront.reset(new GpuWavefront(width, height, fov, frameUniforms, shaders, variantDefines));
+			}
+			else {
+				tracerShader = createTracerShader(tracer, workgroup, shaders, variantDefines);
+			}
+			if (listTracerShader) {
+				listTracerShader = shaders.compute("PathTracer.comp", "#define PIXEL_LIST\n" + computeDefines(workgroup) + variantDefines);
+			}
+			tracerReady = false;
+		}
+		return true;
+	}
+
+	void waitUntilReady() {
+		while (!isReady()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// Stand-in for traceFrame and resolve while the tracer is still compiling: the
+	// first hit of one ray per pixel, drawn straight into the given framebuffer.
+	// Its program is small and only built on first use.
+	void preview(GLuint targetFrameBuffer, const glm::mat4& view) {
+		if (!previewShader) {
+			previewShader = shaders.program("VertexShader.vs", "PreviewShader.fs", "");
+		}
+		if (!previewConfigured) {
+			previewShader->waitUntilReady();
+			previewShader->use();
+			previewShader->setMat4("proj", projection());
+			frameUniforms.attach(*previewShader);
+			previewConfigured = true;
+		}
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFrameBuffer);
+		glViewport(0, 0, width, height);
+		sceneBuffers.bind();
+		frameUniforms.setCamera(glm::inverse(view));
+		frameUniforms.upload();
+		previewShader->use();
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	}
+
+	// side of the square tiles the compute tracer dispatches one at a time, 0 = whole image
+	void setTileSize(unsigned int size) {
+		tileSize = size;
+	}
+
+	// workgroups the persistent tracer launches. OpenGL cannot tell how many the device
+	// runs at once, so this is a guess that should exceed it; extra groups find the
+	// counter exhausted and exit right away.
+	void setPersistentGroups(unsigned int groups) {
+		persistentGroups = groups > 0 ? groups : DEFAULT_PERSISTENT_GROUPS;
+	}
+
+	unsigned int persistentGroupCount() const {
+		return persistentGroups;
+	}
+
+	// first pass: trace samples paths per pixel (see SampleBatch) and add them to the
+	// accumulation texture. Waits for the tracer programs if they are still building.
+	void traceFrame(const glm::mat4& view, bool cameraIsMoving, unsigned int samples = 1) {
+		waitUntilReady();
+		if (convergence && cameraIsMoving) {
+			convergence->reset();
+		}
+		else if (convergence) {
+			convergence->beforePass(VAO);
+		}
+		bool masked = convergence && convergence->isValid();
+		beginFrame(view, cameraIsMoving, samples);
+		if (tracer == TracerType::Wavefront) {
+			wavefront->traceFrame(renderedTexture, squaresTexture, samples);
+			return;
+		}
+		if (tracer == TracerType::Persistent) {
+			GLuint zero = 0;
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, workCounter);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+			glDispatchCompute(persistentGroups, 1, 1);
+			endFrame();
+			return;
+		}
+		if (tracer == TracerType::Fragment) {
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+			glViewport(0, 0, width, height);
+			if (cameraIsMoving) {
+				const GLfloat empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				glClearBufferfv(GL_COLOR, 0, empty);
+				glClearBufferfv(GL_COLOR, 1, empty);
+			}
+			//the blend unit adds the new sample, so the pass never reads the texture it
+			//renders to and there is no feedback loop to synchronize
+			glEnable(GL_BLEND);
+			glBlendEquation(GL_FUNC_ADD);
+			glBlendFunc(GL_ONE, GL_ONE);
+			if (masked) {
+				convergence->enableStencilTest();
+			}
+			glBindVertexArray(VAO);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			glDisable(GL_STENCIL_TEST);
+			glDisable(GL_BLEND);
+			return;
+		}
+		if (masked) {
+			listTracerShader->use();
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, convergence->pixelList());
+			glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, convergence->pixelList());
+			glDispatchComputeIndirect(0);
+			glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+			endFrame();
+			return;
+		}
+		unsigned int tile = tileSize > 0 ? tileSize : std::max(width, height);
+		for (unsigned int y = 0; y < height; y += tile) {
+			for (unsigned int x = 0; x < width; x += tile) {
+				traceTile(x, y, std::min(x + tile, width), std::min(y + tile, height));
+			}
+		}
+		endFrame();
+	}
+
+	// Time slicing: traces the next tiles of progress, restarting the ones that have
+	// no samples yet, so a frame only costs as many tiles as the caller budgets for.
+	// The wavefront and persistent tracers cannot trace part of the image; they
+	// trace the whole frame and count it for every tile.
+	void traceTiles(const glm::mat4& view, TileProgress& progress, unsigned int tiles, unsigned int samples = 1) {
+		if (tracer == TracerType::Wavefront || tracer == TracerType::Persistent) {
+			traceFrame(view, !progress.complete(), samples);
+			progress.frameTraced(samples);
+			return;
+		}
+		beginFrame(view, false, samples);
+		for (unsigned int i = 0; i < tiles; i++) {
+			TileProgress::Tile tile = progress.nextTile();
+			if (progress.samples(tile.index) == 0) {
+				clearTile(tile.x0, tile.y0, tile.x1, tile.y1);
+			}
+			traceTile(tile.x0, tile.y0, tile.x1, tile.y1);
+			progress.tileTraced(samples);
+		}
+		endFrame();
+	}
+
+	// Adaptive sampling: traces every tile with the samples per pixel the sampler
+	// hands it for an average of samples over the image, dropping all samples first
+	// when the camera moved. The wavefront and persistent tracers cannot trace part
+	// of the image; they trace the whole frame uniformly. Returns the paths traced.
+	double traceAdaptive(const glm::mat4& view, bool cameraIsMoving, AdaptiveSampler& sampler, unsigned int samples) {
+		if (tracer == TracerType::Wavefront || tracer == TracerType::Persistent) {
+			traceFrame(view, cameraIsMoving, samples);
+			return (double)samples * width * height;
+		}
+		if (cameraIsMoving) {
+			sampler.reset();
+			clearTile(0, 0, width, height);
+		}
+		const std::vector<unsigned int>& counts = sampler.allocate(samples);
+		beginFrame(view, false, samples);
+		double paths = 0.0;
+		for (unsigned int i = 0; i < sampler.tileCount(); i++) {
+			if (counts[i] == 0) {
+				continue;
+			}
+			AdaptiveSampler::Tile tile = sampler.tile(i);
+			frameUniforms.setSamplesPerPixel(counts[i]);
+			frameUniforms.upload();
+			traceTile(tile.x0, tile.y0, tile.x1, tile.y1);
+			paths += (double)counts[i] * (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+		}
+		endFrame();
+		sampler.frameTraced(renderedTexture, squaresTexture);
+		return paths;
+	}
+
+	// Fragment and compute tracers: the pieces of traceFrame, for callers that launch
+	// tiles themselves. beginFrame sets the per frame uniforms, traceTile adds samples
+	// paths per pixel of [x0, x1) x [y0, y1) with its own dispatch or scissored draw,
+	// and endFrame makes the results visible to the view pass.
+	void beginFrame(const glm::mat4& view, bool cameraIsMoving, unsigned int samples = 1) {
+		waitUntilReady();
+		sceneBuffers.bind();
+		frameUniforms.setCamera(glm::inverse(view));
+		frameUniforms.setCameraIsMoving(cameraIsMoving);
+		frameUniforms.setRandomVector(glm::vec2(rand() / (RAND_MAX + 1.0), rand() / (2 * (RAND_MAX + 1.0))));
+		frameUniforms.setSamplesPerPixel(samples);
+		frameUniforms.upload();
+		if (tracer == TracerType::Wavefront) {
+			return;
+		}
+		tracerShader->use();
+		if (tracer == TracerType::Compute || tracer == TracerType::Persistent) {
+			glBindImageTexture(0, renderedTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+			glBindImageTexture(1, squaresTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+		}
+	}
+
+	void traceTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+		if (tracer == TracerType::Fragment) {
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+			glViewport(0, 0, width, height);
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(x0, y0, x1 - x0, y1 - y0);
+			glEnable(GL_BLEND);
+			glBlendEquation(GL_FUNC_ADD);
+			glBlendFunc(GL_ONE, GL_ONE);
+			glBindVertexArray(VAO);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			glDisable(GL_BLEND);
+			glDisable(GL_SCISSOR_TEST);
+			return;
+		}
+		tracerShader->setUVec2(tileOffsetLocation, x0, y0);
+		tracerShader->setUVec2(tileEndLocation, x1, y1);
+		glDispatchCompute((x1 - x0 + workgroup.x - 1) / workgroup.x, (y1 - y0 + workgroup.y - 1) / workgroup.y, 1);
+	}
+
+	void endFrame() {
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	// drops the accumulated samples of [x0, x1) x [y0, y1)
+	void clearTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+		const GLfloat empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearTexSubImage(renderedTexture, 0, x0, y0, 0, x1 - x0, y1 - y0, 1, GL_RGBA, GL_FLOAT, empty);
+		glClearTexSubImage(squaresTexture, 0, x0, y0, 0, x1 - x0, y1 - y0, 1, GL_RED, GL_FLOAT, empty);
+	}
+
+	// second pass: every pixel's accumulated samples divided by its own count into
+	// the given framebuffer. Pixels without samples are left as they are in the
+	// target, e.g. a preview under tiles a time sliced image has not reached yet.
+	void resolve(GLuint targetFrameBuffer) {
+		waitUntilReady();
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFrameBuffer);
+		glViewport(0, 0, width, height);
+		frameUniforms.upload();
+		viewShader->use();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, renderedTexture);
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	}
+
+private:
+	float fov;
+	TracerType tracer;
+	glm::uvec2 workgroup;
+	unsigned int tileSize = 0;
+	static const unsigned int DEFAULT_PERSISTENT_GROUPS = 256;
+	unsigned int persistentGroups = DEFAULT_PERSISTENT_GROUPS;
+	GLuint workCounter = 0;
+	std::unique_ptr<ShaderLibrary> ownLibrary;
+	ShaderLibrary& shaders;
+	std::string variantDefines;
+	std::shared_ptr<Shader> tracerShader;			//null for the wavefront tracer
+	std::shared_ptr<Shader> listTracerShader;		//compute tracer over the convergence mask's pixel list
+	std::shared_ptr<Shader> viewShader;
+	std::shared_ptr<Shader> previewShader;			//built on first use
+	bool tracerReady = false;
+	bool previewConfigured = false;
+	SceneBuffers sceneBuffers;
+	std::unique_ptr<GpuWavefront> wavefront;
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	GLuint frameBuffer = 0;
+	GLuint renderedTexture = 0;					//color sum, sample count in alpha
+	GLuint squaresTexture = 0;					//sum of squared luminances
+	std::unique_ptr<ConvergenceMask> convergence;
+	bool frameBufferComplete = false;
+	FrameUniforms frameUniforms;
+	GLint tileOffsetLocation = -1;
+	GLint tileEndLocation = -1;
+
+	glm::mat4 projection() const {
+		return glm::perspective(glm::radians(fov * 0.5f), (float)width / (float)height, 0.1f, 100.0f);
+	}
+
+	static std::shared_ptr<Shader> createTracerShader(TracerType tracer, glm::uvec2 workgroup, ShaderLibrary& library, const std::string& variantDefines) {
+		if (tracer == TracerType::Wavefront) {
+			return nullptr;
+		}
+		if (tracer == TracerType::Persistent) {
+			return library.compute("PersistentTracer.comp", "#define WORKGROUP_SIZE " + std::to_string(workgroup.x * workgroup.y) + "\n" + variantDefines);
+		}
+		if (tracer == TracerType::Compute) {
+			return library.compute("PathTracer.comp", computeDefines(workgroup) + variantDefines);
+		}
+		return library.program("VertexShader.vs", "FragmentShader.fs", variantDefines);
+	}
+
+	static std::string computeDefines(glm::uvec2 workgroup) {
+		return "#define WORKGROUP_X " + std::to_string(workgroup.x) + "\n#define WORKGROUP_Y " + std::to_string(workgroup.y) + "\n";
+	}
+
+	void createFrameBuffer() {
+		GLint originalFrameBuffer;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &originalFrameBuffer);
+		//CREATE FRAME BUFFER
+		glGenFramebuffers(1, &frameBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+		//CREATE TEXTURE (RGBA so the compute tracer can bind it as an rgba32f image)
+		glGenTextures(1, &renderedTexture);
+		glBindTexture(GL_TEXTURE_2D, renderedTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glGenTextures(1, &squaresTexture);
+		glBindTexture(GL_TEXTURE_2D, squaresTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		//CONFIGURE FRAME BUFFER (no depth attachment, the tracer draws a single quad)
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, renderedTexture, 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, squaresTexture, 0);
+		GLenum drawbuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawbuffers);
+		frameBufferComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		//start from an empty accumulation buffer, no samples in alpha
+		const GLfloat empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, empty);
+		glClearBufferfv(GL_COLOR, 1, empty);
+		glBindFramebuffer(GL_FRAMEBUFFER, originalFrameBuffer);
+	}
+};
+
+#endif
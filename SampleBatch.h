@@ -0,0 +1,71 @@
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <algorithm>
+#include <cmath>
+
+// How many paths per pixel one tracer pass adds. Every pass also pays for its
+// draw or dispatches, the frame uniform upload and, in the window, the buffer
+// swap, so tracing several samples per pass reaches a sample count sooner.
+// The count is either fixed or, with a target time, steered by the measured GPU
+// time of the tracer pass (GpuTimer) so a pass takes about that long. MAX_SAMPLES
+// bounds a single pass, since a long one delays input and can trip the driver's
+// GPU watchdog. Time sliced rendering uses the same controller for the number
+// of tiles per frame, with the tile count as the limit.
+class SampleBatch {
+public:
+	static const unsigned int MAX_SAMPLES = 64;
+
+	// targetMs = 0 keeps samples per pass fixed
+	explicit SampleBatch(unsigned int samples = 1, double targetMs = 0.0, unsigned int limit = MAX_SAMPLES) :
+		limit(std::max(limit, 1u)),
+		budget(std::min(std::max(samples, 1u), this->limit)),
+		targetMs(targetMs)
+	{
+	}
+
+	unsigned int samples() const {
+		return (unsigned int)std::min(std::max(std::floor(budget), 1.0), (double)limit);
+	}
+
+	bool adaptive() const {
+		return targetMs > 0.0;
+	}
+
+	// smoothed milliseconds per sample per pixel, 0 before the first measurement
+	double sampleMs() const {
+		return costMs;
+	}
+
+	// A pass that traced `traced` samples per pixel took `ms` on the GPU. The
+	// measurements arrive a few frames late and the batch may have changed since,
+	// so the controller works on the cost of one sample rather than on the pass
+	// time: it smooths that cost, then moves the fractional budget part of the way
+	// toward the count that meets the target. Keeping the fraction lets the count
+	// settle between two integers instead of jumping back and forth, and flooring
+	// it errs on the side of short frames.
+	void frameFinished(unsigned int traced, double ms) {
+		if (traced == 0 || ms <= 0.0) {
+			return;
+		}
+		double cost = ms / traced;
+		costMs = costMs > 0.0 ? costMs + COST_SMOOTHING * (cost - costMs) : cost;
+		if (!adaptive()) {
+			return;
+		}
+		double ideal = targetMs / costMs;
+		budget += GAIN * (ideal - budget);
+		budget = std::min(std::max(budget, 1.0), limit + 0.999);
+	}
+
+private:
+	static constexpr double COST_SMOOTHING = 0.25;	//weight of the newest cost measurement
+	static constexpr double GAIN = 0.5;				//share of the error corrected per measurement
+
+	unsigned int limit;
+	double budget;									//samples per pass, floored by samples()
+	double targetMs;
+	double costMs = 0.0;
+};
+
+#endif
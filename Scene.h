@@ -0,0 +1,119 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Sphere.h"
+#include "Plane.h"
+#include "Material.h"
+#include "Light.h"
+
+class Scene {
+public:
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	std::vector<Light> lights;
+
+	static Scene createDefault() {
+		Scene scene;
+		scene.spheres = {
+			Sphere(glm::vec3(0.0f, 0.0f, 0.0f), 2.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))),      //metallic1
+			Sphere(glm::vec3(6.0f, -0.5f, 4.0f), 1.5f, Material(false, true, glm::vec3(1.0f, 0.7f, 0.4f))),     //metallic2
+			Sphere(glm::vec3(1.0f, -1.5f, 5.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 0.0f, 0.0f))),     //red
+			Sphere(glm::vec3(-2.0f, -1.0f, 6.0f), 1.0f, Material(true, false, glm::vec3(0.9f, 0.5f, 0.9f))),    //purple pink
+			Sphere(glm::vec3(3.0f, -1.0f, 4.0f), 1.0f, Material(true, false, glm::vec3(0.0f, 1.0f, 0.0f))),     //green
+			Sphere(glm::vec3(4.5f, -1.5f, 8.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 0.6f, 0.5f))),     //mellow pink
+			Sphere(glm::vec3(-3.0f, -1.5f, 8.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 1.0f, 0.0f))),    //yellow
+		};
+		scene.planes = {
+			Plane(glm::vec3(0,1.0f,0), glm::vec3(0,-2.0f,0), 100.0f, Material(true, false, glm::vec3(0.5f, 0.5f, 0.5f))),  //ground
+			Plane(glm::vec3(0.7071067f,0.0f,0.7071067f), glm::vec3(-5.0f,0,0), 5.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))), //mirror1
+			Plane(glm::vec3(0.7071067f,0.0f,0.7071067f), glm::vec3(-5.0f,0,0), 5.5f, Material(true, false, glm::vec3(0.4f, 0.3f, 0.9f))), //background
+			Plane(glm::vec3(-0.7071067f,0.0f,0.7071067f), glm::vec3(5,0,-8.0f), 10.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))), //mirror
+			Plane(glm::vec3(-0.7071067f,0.0f,0.7071067f), glm::vec3(5,0,-8.0f), 10.5f, Material(true, false, glm::vec3(0.9f, 1.0f, 0.8f))), //background
+		};
+		scene.lights = {
+			Light(glm::vec3(0.0f, 10.0f, 15.0f), glm::vec3(1.0f,1.0f,1.0f))
+		};
+		return scene;
+	}
+
+	// Sphere and plane indices by decreasing size, the order shadow rays test them in
+	// (Occluded in PathTracing.glsl, SimdIntersector::occluded): an any hit query stops
+	// at the first blocker, and large primitives are the likeliest to be one.
+	std::vector<unsigned int> spheresBySize() const {
+		std::vector<unsigned int> order(spheres.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return spheres[a].radius > spheres[b].radius; });
+		return order;
+	}
+
+	std::vector<unsigned int> planesBySize() const {
+		std::vector<unsigned int> order(planes.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return planes[a].lenght > planes[b].lenght; });
+		return order;
+	}
+
+	// Reads a scene text file (see Scene.txt), one primitive per line:
+	//   sphere <center x y z> <radius> <diffuse|metallic> <attenuation r g b>
+	//   plane <unit normal x y z> <position x y z> <length> <diffuse|metallic> <attenuation r g b>
+	//   light <position x y z> <intensity r g b>
+	// Empty lines and lines starting with # are skipped. On an error the scene is
+	// left unchanged and false is returned.
+	static bool load(const std::string& path, Scene& scene) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cout << "ERROR::SCENE::Could not open " << path << std::endl;
+			return false;
+		}
+		Scene loaded;
+		std::string line;
+		for (unsigned int number = 1; std::getline(file, line); number++) {
+			std::istringstream words(line);
+			std::string kind;
+			if (!(words >> kind) || kind[0] == '#') {
+				continue;
+			}
+			glm::vec3 a, b, color;
+			float size;
+			std::string material;
+			bool valid = false;
+			if (kind == "sphere") {
+				valid = (bool)(words >> a.x >> a.y >> a.z >> size >> material >> color.r >> color.g >> color.b);
+				if (valid && (material == "diffuse" || material == "metallic")) {
+					loaded.spheres.push_back(Sphere(a, size, Material(material == "diffuse", material == "metallic", color)));
+				}
+			}
+			else if (kind == "plane") {
+				valid = (bool)(words >> a.x >> a.y >> a.z >> b.x >> b.y >> b.z >> size >> material >> color.r >> color.g >> color.b);
+				if (valid && (material == "diffuse" || material == "metallic")) {
+					loaded.planes.push_back(Plane(a, b, size, Material(material == "diffuse", material == "metallic", color)));
+				}
+			}
+			else if (kind == "light") {
+				valid = (bool)(words >> a.x >> a.y >> a.z >> color.r >> color.g >> color.b);
+				material = "diffuse";
+				if (valid) {
+					loaded.lights.push_back(Light(a, color));
+				}
+			}
+			if (!valid || (material != "diffuse" && material != "metallic")) {
+				std::cout << "ERROR::SCENE::" << path << ":" << number << ": cannot read \"" << line << "\"" << std::endl;
+				return false;
+			}
+		}
+		scene = loaded;
+		return true;
+	}
+};
+
+#endif
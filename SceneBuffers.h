@@ -0,0 +1,200 @@
+#ifndef SCENE_BUFFERS_H
+#define SCENE_BUFFERS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Scene.h"
+
+// std430 copies of the scene structs in PathTracing.glsl. vec3 members are 16 byte
+// aligned there, so the padding is spelled out.
+struct GpuMaterial {
+	glm::vec3 attenuation;
+	GLuint diffuse;
+	GLuint metallic;
+	GLuint padding[3];
+};
+
+struct GpuSphere {
+	glm::vec3 center;
+	float radius;
+	GLuint material;
+	GLuint occluder;
+	GLuint padding[2];
+};
+
+struct GpuPlane {
+	glm::vec3 normal;
+	float lenght;
+	glm::vec3 position;
+	GLuint material;
+	GLuint occluder;
+	GLuint padding[3];
+};
+
+struct GpuLight {
+	glm::vec3 position;
+	float padding0;
+	glm::vec3 intensity;
+	float padding1;
+};
+
+static_assert(sizeof(GpuMaterial) == 32 && sizeof(GpuSphere) == 32 && sizeof(GpuPlane) == 48 && sizeof(GpuLight) == 32,
+	"scene structs must match their std430 layout");
+
+// Scene arrays as shader storage buffers, one glBufferData per array. The shaders
+// take the element counts from the buffer lengths, so the scene size is only
+// limited by GL_MAX_SHADER_STORAGE_BLOCK_SIZE. Identical materials are stored once.
+// The order shadow rays test the primitives in rides along in the occluder member:
+// element k of each array names the k-th largest primitive of its kind. A separate
+// block would be the ninth in the wavefront stage, and GL 4.3 only guarantees 8.
+class SceneBuffers {
+public:
+	//binding points of the Materials, Spheres, Planes and Lights blocks
+	static const GLuint MATERIAL_BINDING = 4;
+	static const GLuint SPHERE_BINDING = 5;
+	static const GLuint PLANE_BINDING = 6;
+	static const GLuint LIGHT_BINDING = 7;
+
+	// what update() had to do
+	enum class Change {
+		None,		//same scene, nothing uploaded
+		Contents,	//same array sizes, the changed elements were rewritten
+		Layout		//an array changed size and was reallocated
+	};
+
+	explicit SceneBuffers(const Scene& scene) {
+		pack(scene);
+		glGenBuffers(4, buffers);
+		upload(buffers[0], materials);
+		upload(buffers[1], spheres);
+		upload(buffers[2], planes);
+		upload(buffers[3], lights);
+	}
+
+	// Applies an edited scene. Arrays that kept their size only get the span of
+	// elements that differ rewritten with glBufferSubData.
+	Change update(const Scene& scene) {
+		std::vector<GpuMaterial> oldMaterials;
+		std::vector<GpuSphere> oldSpheres;
+		std::vector<GpuPlane> oldPlanes;
+		std::vector<GpuLight> oldLights;
+		oldMaterials.swap(materials);
+		oldSpheres.swap(spheres);
+		oldPlanes.swap(planes);
+		oldLights.swap(lights);
+		pack(scene);
+		Change change = Change::None;
+		change = std::max(change, updateArray(buffers[0], oldMaterials, materials));
+		change = std::max(change, updateArray(buffers[1], oldSpheres, spheres));
+		change = std::max(change, updateArray(buffers[2], oldPlanes, planes));
+		change = std::max(change, updateArray(buffers[3], oldLights, lights));
+		return change;
+	}
+
+	~SceneBuffers() {
+		glDeleteBuffers(4, buffers);
+	}
+
+	SceneBuffers(const SceneBuffers&) = delete;
+	SceneBuffers& operator=(const SceneBuffers&) = delete;
+
+	void bind() const {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, buffers[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPHERE_BINDING, buffers[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PLANE_BINDING, buffers[2]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, buffers[3]);
+	}
+
+	unsigned int uniqueMaterials() const {
+		return (unsigned int)materials.size();
+	}
+
+private:
+	GLuint buffers[4] = { 0, 0, 0, 0 };
+	//what the buffers hold, to find the elements an update changes
+	std::vector<GpuMaterial> materials;
+	std::vector<GpuSphere> spheres;
+	std::vector<GpuPlane> planes;
+	std::vector<GpuLight> lights;
+
+	void pack(const Scene& scene) {
+		std::vector<unsigned int> spheresBySize = scene.spheresBySize();
+		std::vector<unsigned int> planesBySize = scene.planesBySize();
+		for (size_t i = 0; i < scene.spheres.size(); i++) {
+			const Sphere& sphere = scene.spheres[i];
+			spheres.push_back({ sphere.center, sphere.radius, materialIndex(materials, sphere.mtl), spheresBySize[i], { 0, 0 } });
+		}
+		for (size_t i = 0; i < scene.planes.size(); i++) {
+			const Plane& plane = scene.planes[i];
+			planes.push_back({ plane.normal, plane.lenght, plane.position, materialIndex(materials, plane.mtl), planesBySize[i], { 0, 0, 0 } });
+		}
+		for (const Light& light : scene.lights) {
+			lights.push_back({ light.position, 0.0f, light.intensity, 0.0f });
+		}
+	}
+
+	template<class T>
+	static Change updateArray(GLuint buffer, const std::vector<T>& before, const std::vector<T>& after) {
+		if (before.size() != after.size()) {
+			upload(buffer, after);
+			return Change::Layout;
+		}
+		size_t first = 0;
+		size_t last = after.size();
+		while (first < last && memcmp(&before[first], &after[first], sizeof(T)) == 0) {
+			first++;
+		}
+		while (last > first && memcmp(&before[last - 1], &after[last - 1], sizeof(T)) == 0) {
+			last--;
+		}
+		if (first == last) {
+			return Change::None;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(T), (last - first) * sizeof(T), &after[first]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return Change::Contents;
+	}
+
+	static GLuint materialIndex(std::vector<GpuMaterial>& materials, const Material& mtl) {
+		for (size_t i = 0; i < materials.size(); i++) {
+			if (materials[i].attenuation == mtl.attenuation && (materials[i].diffuse != 0) == mtl.diffuse && (materials[i].metallic != 0) == mtl.metallic) {
+				return (GLuint)i;
+			}
+		}
+		materials.push_back({ mtl.attenuation, (GLuint)mtl.diffuse, (GLuint)mtl.metallic, { 0, 0, 0 } });
+		return (GLuint)(materials.size() - 1);
+	}
+
+	// an empty array becomes a zero sized buffer, which length() reports as 0
+	template<class T>
+	static void upload(GLuint buffer, const std::vector<T>& data) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(T), data.empty() ? NULL : data.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+};
+
+// image size and the camera constants GeneratePrimaryRay and the compute passes use
+inline void setImageUniforms(const Shader& shader, unsigned int width, unsigned int height, float fov) {
+	float aspectRatio = (float)width / (float)height;
+	float ff = tan(glm::radians(fov * 0.5f));
+	shader.use();
+	shader.setFloat("view_pixel_width", (float)(2.0f * aspectRatio * ff / width));
+	shader.setFloat("view_pixel_height", (float)(2.0f * ff / height));
+	shader.setUInt("width", width);
+	shader.setUInt("height", height);
+	//the visible part of the quad; the compute passes rebuild pixelPos from it
+	float tanHalf = tan(glm::radians(fov * 0.5f) * 0.5f);
+	shader.setVec2("viewHalfExtent", aspectRatio * tanHalf, tanHalf);
+}
+
+#endif
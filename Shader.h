@@ -4,115 +4,602 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <thread>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <atomic>
+
+#include "ShaderCompiler.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 class Shader
 {
 public:
     unsigned int ID;
 
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // no program (ID 0), for passes that are not used
+    Shader() : ID(0)
     {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
+    }
 
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
+    // defines is a block of "#define NAME value" lines inserted right after #version.
+    // With a compiler the build may still be running when the constructor returns;
+    // the program must not be used before isReady() returned true.
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "", ShaderCompiler* compiler = nullptr) :
+        ID(0),
+        stagePaths{ { GL_VERTEX_SHADER, vertexPath }, { GL_FRAGMENT_SHADER, fragmentPath } },
+        defines(defines)
+    {
+        build(loadStages(files), compiler);
+    }
 
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            vShaderFile.close();
-            fShaderFile.close();
+    // compute program
+    explicit Shader(const char* computePath, const std::string& defines = "", ShaderCompiler* compiler = nullptr) :
+        ID(0),
+        stagePaths{ { GL_COMPUTE_SHADER, computePath } },
+        defines(defines)
+    {
+        build(loadStages(files), compiler);
+    }
 
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
+    // Every file the program was built from, includes too; what a watcher has to watch.
+    const std::vector<std::string>& sourceFiles() const
+    {
+        return files;
+    }
+
+    // True if the files on disk now expand to different sources than the program was
+    // built from; saving a file without changing its text keeps the program.
+    bool sourcesChanged() const
+    {
+        std::vector<std::string> current;
+        return sourceKey(loadStages(current)) != key;
+    }
+
+    // the same program built again from the current files, e.g. after an edit
+    Shader rebuilt(ShaderCompiler* compiler = nullptr) const
+    {
+        Shader shader;
+        shader.stagePaths = stagePaths;
+        shader.defines = defines;
+        shader.build(shader.loadStages(shader.files), compiler);
+        return shader;
+    }
+
+    // false if compiling or linking failed; only meaningful once isReady()
+    bool isLinked() const
+    {
+        GLint success = GL_FALSE;
+        if (ID != 0)
         {
-            std::cout << "ERROR::SHADERFILE_NOT_SUCCESFULLY_READ" << std::endl;
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
+        return success == GL_TRUE;
+    }
 
-        unsigned int vertex, fragment;
+    // Directory for linked program binaries, created on first use (default "shader_cache").
+    // An empty string turns the cache off and every program is compiled from source.
+    static void setBinaryCacheDirectory(const std::string& directory)
+    {
+        binaryCacheDirectory() = directory;
+    }
 
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+    // Reads a shader file and expands #include "file" lines (paths relative to the
+    // including file). The defines are inserted after the #version line so they
+    // are seen by every included file.
+    static std::string loadSource(const std::string& path, const std::string& defines = "", std::vector<std::string>* files = nullptr)
+    {
+        std::string code = expandIncludes(path, 0, files);
+        if (!defines.empty())
+        {
+            size_t version = code.find("#version");
+            size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+            size_t insertAt = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+            code.insert(insertAt, defines + (defines.back() == '\n' ? "" : "\n"));
+        }
+        return code;
+    }
 
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+    void use() const
+    {
+        glUseProgram(ID);
+    }
 
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    // Polls a build started with a compiler and finishes it (error log, binary cache,
+    // uniform tables) once it is done. Never blocks; always true for blocking builds.
+    bool isReady()
+    {
+        if (!pending)
+        {
+            return true;
+        }
+        bool done = workerDone ? workerDone->load(std::memory_order_acquire) : completionStatus();
+        if (done)
+        {
+            finishBuild();
+        }
+        return done;
+    }
 
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    // blocks until the build is done
+    void waitUntilReady()
+    {
+        while (!isReady())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
 
+    // Location of an active uniform, looked up in the table built at link time
+    // (-1 if the program has no such uniform, like glGetUniformLocation). Uniforms
+    // set every frame should resolve their location once and use the GLint overloads.
+    GLint uniformLocation(const std::string& name) const
+    {
+        auto found = uniformLocations.find(name);
+        return found == uniformLocations.end() ? -1 : found->second;
     }
 
-    void use() const
+    // binds the named uniform block to a binding point; false if the program has no such block
+    bool bindUniformBlock(const std::string& name, GLuint binding) const
     {
-        glUseProgram(ID);
+        auto found = uniformBlocks.find(name);
+        if (found == uniformBlocks.end())
+        {
+            return false;
+        }
+        glUniformBlockBinding(ID, found->second, binding);
+        return true;
     }
 
     // utility uniform functions
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(uniformLocation(name), value);
+    }
+    void setBool(GLint location, bool value) const
+    {
+        glUniform1i(location, (int)value);
+    }
+
+    void setInt(const std::string& name, int value) const
+    {
+        setInt(uniformLocation(name), value);
+    }
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
     }
 
     void setUInt(const std::string& name, unsigned int value) const
     {
-        glUniform1ui(glGetUniformLocation(ID, name.c_str()), (unsigned int)value);
+        setUInt(uniformLocation(name), value);
+    }
+    void setUInt(GLint location, unsigned int value) const
+    {
+        glUniform1ui(location, value);
     }
 
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(uniformLocation(name), value);
+    }
+    void setFloat(GLint location, float value) const
+    {
+        glUniform1f(location, value);
     }
 
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniformLocation(name), value);
+    }
+    void setVec2(GLint location, const glm::vec2& value) const
+    {
+        glUniform2fv(location, 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(uniformLocation(name), x, y);
+    }
+
+    void setUVec2(const std::string& name, unsigned int x, unsigned int y) const
+    {
+        setUVec2(uniformLocation(name), x, y);
+    }
+    void setUVec2(GLint location, unsigned int x, unsigned int y) const
+    {
+        glUniform2ui(location, x, y);
     }
 
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(uniformLocation(name), value);
+    }
+    void setVec3(GLint location, const glm::vec3& value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(uniformLocation(name), x, y, z);
     }
 
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniformLocation(name), mat);
+    }
+    void setMat4(GLint location, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    void checkCompileErrors(GLuint shader, std::string type)
+    typedef std::vector<std::pair<GLenum, std::string>> StageSources;
+
+    std::vector<std::pair<GLenum, std::string>> stagePaths;
+    std::string defines;
+    std::vector<std::string> files;
+    std::string key;                    //hash of the expanded sources the program was built from
+
+    std::unordered_map<std::string, GLint> uniformLocations;
+    std::unordered_map<std::string, GLuint> uniformBlocks;
+
+    //state of a build that was started but not finished yet
+    bool pending = false;
+    std::vector<std::pair<GLenum, unsigned int>> pendingStages;
+    std::shared_ptr<std::atomic<bool>> workerDone;
+    std::string pendingLabel;
+    std::string pendingCachePath;
+    std::chrono::steady_clock::time_point buildStart;
+
+    static std::string& binaryCacheDirectory()
+    {
+        static std::string directory = "shader_cache";
+        return directory;
+    }
+
+    // Links the program from the binary cache when the driver accepts the cached
+    // binary, otherwise compiles the stages and stores the linked binary for the
+    // next run. The binaries are only valid for the driver that produced them, so
+    // the cache key covers GL_RENDERER and GL_VERSION as well as the sources.
+    // Loading a cached binary is always synchronous; compiling is started in the
+    // background when the compiler's mode allows it.
+    void build(const StageSources& stages, ShaderCompiler* compiler)
+    {
+        buildStart = std::chrono::steady_clock::now();
+        pendingLabel.clear();
+        for (const auto& stage : stagePaths)
+        {
+            pendingLabel += (pendingLabel.empty() ? "" : " + ") + stage.second;
+        }
+        pendingCachePath.clear();
+        key = sourceKey(stages);
+        if (!binaryCacheDirectory().empty())
+        {
+            pendingCachePath = binaryCacheDirectory() + "/" + key + ".bin";
+            if (loadBinary(pendingCachePath))
+            {
+                std::cout << "Shader cache hit: " << pendingLabel << " (" << elapsedMs(buildStart) << " ms)" << std::endl;
+                reflectInterface();
+                return;
+            }
+        }
+
+        CompileMode mode = compiler ? compiler->mode() : CompileMode::Blocking;
+        ID = glCreateProgram();
+        if (!pendingCachePath.empty())
+        {
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        pending = true;
+        if (mode == CompileMode::Thread)
+        {
+            //the program name is shared, the worker compiles and links into it
+            unsigned int program = ID;
+            workerDone = compiler->submit([program, stages]()
+            {
+                std::vector<unsigned int> shaders = compileStages(program, stages);
+                glLinkProgram(program);
+                for (size_t i = 0; i < shaders.size(); i++)
+                {
+                    checkCompileErrors(shaders[i], stageName(stages[i].first));
+                    glDeleteShader(shaders[i]);
+                }
+            });
+            return;
+        }
+
+        std::vector<unsigned int> shaders = compileStages(ID, stages);
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            pendingStages.push_back({ stages[i].first, shaders[i] });
+        }
+        glLinkProgram(ID);
+        if (mode == CompileMode::Blocking)
+        {
+            finishBuild();
+        }
+    }
+
+    // creates, compiles and attaches one shader per stage; no status queries, so
+    // nothing waits for a parallel compile
+    static std::vector<unsigned int> compileStages(unsigned int program, const StageSources& stages)
+    {
+        std::vector<unsigned int> shaders;
+        for (const auto& stage : stages)
+        {
+            const char* code = stage.second.c_str();
+            unsigned int shader = glCreateShader(stage.first);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(program, shader);
+            shaders.push_back(shader);
+        }
+        return shaders;
+    }
+
+    bool completionStatus() const
+    {
+        GLint done = GL_TRUE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    void finishBuild()
+    {
+        for (const auto& stage : pendingStages)
+        {
+            checkCompileErrors(stage.second, stageName(stage.first));
+            glDeleteShader(stage.second);
+        }
+        checkCompileErrors(ID, "PROGRAM");
+        if (!pendingCachePath.empty())
+        {
+            std::cout << "Shader cache miss: " << pendingLabel << ", compiled in " << elapsedMs(buildStart) << " ms" << std::endl;
+            saveBinary(pendingCachePath);
+        }
+        reflectInterface();
+        pending = false;
+        pendingStages.clear();
+        workerDone.reset();
+    }
+
+    // false if there is no cached binary or the driver rejects it; ID is left 0 then
+    bool loadBinary(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        GLenum format = 0;
+        if (!file.read(reinterpret_cast<char*>(&format), sizeof(format)))
+        {
+            return false;
+        }
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+        {
+            return false;
+        }
+
+        ID = glCreateProgram();
+        glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            //driver update or a binary from another GPU; compile from source and overwrite it
+            std::cout << "Shader cache: binary rejected, recompiling " << path << std::endl;
+            glDeleteProgram(ID);
+            ID = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void saveBinary(const std::string& path) const
+    {
+        GLint success = 0;
+        GLint length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+        {
+            return;
+        }
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(binaryCacheDirectory(), error);
+        //write a private file and rename it over the entry, so another job never
+        //reads a partial binary and a killed one leaves no truncated entry behind
+        std::string temporary = path + ".tmp." + std::to_string(processId());
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+            file.write(binary.data(), binary.size());
+            file.close();
+            if (file)
+            {
+                std::filesystem::rename(temporary, path, error);
+                if (!error)
+                {
+                    return;
+                }
+            }
+        }
+        std::filesystem::remove(temporary, error);
+        std::cout << "ERROR::SHADER_CACHE_NOT_WRITTEN: " << path << std::endl;
+    }
+
+    static long processId()
+    {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return getpid();
+#endif
+    }
+
+    // reads the stage files with the defines, listing every file read in readFiles
+    StageSources loadStages(std::vector<std::string>& readFiles) const
+    {
+        readFiles.clear();
+        StageSources stages;
+        for (const auto& stage : stagePaths)
+        {
+            stages.push_back({ stage.first, loadSource(stage.second, defines, &readFiles) });
+        }
+        return stages;
+    }
+
+    // 64 bit FNV-1a of the expanded sources (defines included) and the driver strings, as hex
+    static std::string sourceKey(const StageSources& stages)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const std::string& text)
+        {
+            for (unsigned char c : text)
+            {
+                hash = (hash ^ c) * 1099511628211ull;
+            }
+            //separator so that moving text between parts changes the key
+            hash = (hash ^ 0xff) * 1099511628211ull;
+        };
+        for (const auto& stage : stages)
+        {
+            add(std::to_string(stage.first));
+            add(stage.second);
+        }
+        const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        add(renderer ? renderer : "");
+        add(version ? version : "");
+
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+        return key;
+    }
+
+    static std::string stageName(GLenum stage)
+    {
+        return stage == GL_VERTEX_SHADER ? "VERTEX" : stage == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE";
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // fills the uniform and uniform block tables from the linked program
+    void reflectInterface()
+    {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+        std::string name;
+        for (GLint i = 0; i < count; i++)
+        {
+            name.resize(maxLength > 0 ? maxLength : 1);
+            GLsizei length = 0;
+            glGetProgramResourceName(ID, GL_UNIFORM, i, (GLsizei)name.size(), &length, &name[0]);
+            name.resize(length);
+            const GLenum property = GL_LOCATION;
+            GLint location = -1;
+            glGetProgramResourceiv(ID, GL_UNIFORM, i, 1, &property, 1, NULL, &location);
+            if (location < 0)
+            {
+                //member of a uniform block
+                continue;
+            }
+            uniformLocations[name] = location;
+            //arrays are reported as "name[0]"; also accept the bare name like glGetUniformLocation
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                uniformLocations[name.substr(0, name.size() - 3)] = location;
+            }
+        }
+
+        glGetProgramInterfaceiv(ID, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(ID, GL_UNIFORM_BLOCK, GL_MAX_NAME_LENGTH, &maxLength);
+        for (GLint i = 0; i < count; i++)
+        {
+            name.resize(maxLength > 0 ? maxLength : 1);
+            GLsizei length = 0;
+            glGetProgramResourceName(ID, GL_UNIFORM_BLOCK, i, (GLsizei)name.size(), &length, &name[0]);
+            name.resize(length);
+            uniformBlocks[name] = (GLuint)i;
+        }
+    }
+
+    static std::string expandIncludes(const std::string& path, int depth, std::vector<std::string>* files)
+    {
+        if (depth > 8)
+        {
+            std::cout << "ERROR::SHADER_INCLUDE_TOO_DEEP: " << path << std::endl;
+            return "";
+        }
+        if (files != nullptr && std::find(files->begin(), files->end(), path) == files->end())
+        {
+            files->push_back(path);
+        }
+        std::string source;
+        std::ifstream shaderFile;
+        shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            shaderFile.open(path);
+            std::stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            source = shaderStream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADERFILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return "";
+        }
+
+        size_t slash = path.find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        std::stringstream lines(source);
+        std::string line;
+        std::string code;
+        while (std::getline(lines, line))
+        {
+            size_t first = line.find_first_not_of(" \t");
+            if (first != std::string::npos && line.compare(first, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', first);
+                size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+                if (close != std::string::npos)
+                {
+                    code += expandIncludes(directory + line.substr(open + 1, close - open - 1), depth + 1, files);
+                    continue;
+                }
+            }
+            code += line + "\n";
+        }
+        return code;
+    }
+
+    static void checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -0,0 +1,150 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//GL_KHR_parallel_shader_compile, not part of the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// How Shader builds its programs when it is given a ShaderCompiler:
+// Blocking  compile and link before the constructor returns, like without a compiler
+// Parallel  GL_KHR_parallel_shader_compile: compile and link are issued without
+//           querying their status, the driver works on them in the background and
+//           GL_COMPLETION_STATUS_KHR tells when they are done
+// Thread    compile and link on a worker thread with its own context sharing
+//           objects with the caller's, for drivers without the extension
+enum class CompileMode { Blocking, Parallel, Thread };
+
+// A context that shares objects with the main one, made current on the worker
+// thread before its first job and released after its last.
+struct WorkerContext {
+	std::function<bool()> makeCurrent;
+	std::function<void()> release;
+};
+
+// Lets several programs compile at the same time without stalling the main thread.
+// Shaders created with a compiler start their build and report through
+// Shader::isReady() when it is done; the caller keeps drawing in the meantime.
+class ShaderCompiler {
+public:
+	// Parallel falls back to Thread when the driver does not have the extension, and
+	// Thread falls back to Blocking when there is no worker context.
+	ShaderCompiler(CompileMode requested, const WorkerContext& workerContext = WorkerContext()) :
+		compileMode(requested)
+	{
+		if (compileMode == CompileMode::Parallel && !hasParallelCompile()) {
+			compileMode = CompileMode::Thread;
+		}
+		if (compileMode == CompileMode::Thread) {
+			if (workerContext.makeCurrent) {
+				worker = std::thread(&ShaderCompiler::run, this, workerContext);
+			}
+			else {
+				compileMode = CompileMode::Blocking;
+			}
+		}
+	}
+
+	// finishes the jobs already submitted so their shaders still become ready
+	~ShaderCompiler() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+
+	ShaderCompiler(const ShaderCompiler&) = delete;
+	ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+	CompileMode mode() const {
+		return compileMode;
+	}
+
+	const char* modeName() const {
+		return compileMode == CompileMode::Parallel ? "parallel (GL_KHR_parallel_shader_compile)" :
+			compileMode == CompileMode::Thread ? "worker thread with a shared context" : "blocking";
+	}
+
+	// Thread mode: runs the job on the worker context. The flag is set once the job
+	// and all the GL commands it issued have finished.
+	std::shared_ptr<std::atomic<bool>> submit(std::function<void()> job) {
+		auto done = std::make_shared<std::atomic<bool>>(false);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back({ std::move(job), done });
+		}
+		wake.notify_one();
+		return done;
+	}
+
+	static bool hasParallelCompile() {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++) {
+			const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (extension != NULL && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	struct Job {
+		std::function<void()> work;
+		std::shared_ptr<std::atomic<bool>> done;
+	};
+
+	CompileMode compileMode;
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	bool stopping = false;
+
+	void run(WorkerContext context) {
+		bool current = context.makeCurrent();
+		if (!current) {
+			std::cout << "ERROR::SHADER_COMPILER::Failed to make the worker context current" << std::endl;
+		}
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) {
+					break;
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			if (current) {
+				job.work();
+				//the main context only sees the program once the worker's commands completed
+				glFinish();
+			}
+			job.done->store(true, std::memory_order_release);
+		}
+		if (current && context.release) {
+			context.release();
+		}
+	}
+};
+
+#endif
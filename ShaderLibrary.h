@@ -0,0 +1,196 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+#include "ShaderCompiler.h"
+#include "Scene.h"
+
+// The tracer programs of every renderer, built through one compiler and memoized by
+// their source files and define set, so renderers that need the same variant share
+// one program and many variants can be compiling at once. Programs are deleted when
+// the library and the last renderer using them are gone. Uniforms are per program,
+// so a shared variant only suits passes that set the same values (same image size).
+class ShaderLibrary {
+public:
+	static const unsigned int DEFAULT_MAX_BOUNCE = 50;
+	//largest bounce limit the options accept; MAX_BOUNCE is a loop bound in every tracer
+	static const unsigned int MAX_BOUNCE_LIMIT = 1000;
+
+	// specialize = false builds the uber shader, which reads the counts from the
+	// buffer lengths and keeps every material branch; nextEvent = false builds the
+	// tracers without light sampling (NEXT_EVENT in PathTracing.glsl)
+	explicit ShaderLibrary(ShaderCompiler* compiler = nullptr, bool specialize = true, unsigned int maxBounce = DEFAULT_MAX_BOUNCE,
+		bool nextEvent = true) :
+		shaderCompiler(compiler),
+		specialize(specialize),
+		bounceLimit(maxBounce > 0 ? maxBounce : DEFAULT_MAX_BOUNCE),
+		nextEvent(nextEvent)
+	{
+	}
+
+	~ShaderLibrary() {
+		for (const auto& reload : reloads) {
+			glDeleteProgram(reload.second->ID);
+		}
+	}
+
+	ShaderLibrary(const ShaderLibrary&) = delete;
+	ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+	unsigned int maxBounce() const {
+		return bounceLimit;
+	}
+
+	bool specialized() const {
+		return specialize;
+	}
+
+	bool nextEventEnabled() const {
+		return nextEvent;
+	}
+
+	// The define set PathTracing.glsl is built with for this scene: exact primitive
+	// counts and only the material branches the scene uses, plus the bounce limit
+	// and whether the lights are sampled.
+	std::string variantDefines(const Scene& scene) const {
+		std::string defines = "#define MAX_BOUNCE " + std::to_string(bounceLimit) + "\n";
+		defines += std::string("#define NEXT_EVENT ") + (nextEvent ? "1" : "0") + "\n";
+		if (!specialize) {
+			return defines;
+		}
+		bool diffuse = false;
+		bool metallic = false;
+		for (const Sphere& sphere : scene.spheres) {
+			diffuse = diffuse || sphere.mtl.diffuse;
+			metallic = metallic || sphere.mtl.metallic;
+		}
+		for (const Plane& plane : scene.planes) {
+			diffuse = diffuse || plane.mtl.diffuse;
+			metallic = metallic || plane.mtl.metallic;
+		}
+		defines += "#define NUM_SPHERES " + std::to_string(scene.spheres.size()) + "\n";
+		defines += "#define NUM_PLANES " + std::to_string(scene.planes.size()) + "\n";
+		defines += "#define NUM_LIGHTS " + std::to_string(scene.lights.size()) + "\n";
+		defines += std::string("#define HAS_DIFFUSE ") + (diffuse ? "1" : "0") + "\n";
+		defines += std::string("#define HAS_METALLIC ") + (metallic ? "1" : "0") + "\n";
+		return defines;
+	}
+
+	std::shared_ptr<Shader> compute(const std::string& path, const std::string& defines) {
+		return find(path + "\n" + defines, [&]() { return new Shader(path.c_str(), defines, shaderCompiler); });
+	}
+
+	std::shared_ptr<Shader> program(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines) {
+		return find(vertexPath + "\n" + fragmentPath + "\n" + defines,
+			[&]() { return new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines, shaderCompiler); });
+	}
+
+	// every file the programs were built from, for a FileWatcher
+	std::vector<std::string> sourceFiles() const {
+		std::vector<std::string> all;
+		for (const auto& entry : programs) {
+			for (const std::string& file : entry.second->sourceFiles()) {
+				if (std::find(all.begin(), all.end(), file) == all.end()) {
+					all.push_back(file);
+				}
+			}
+		}
+		return all;
+	}
+
+	// Starts rebuilding the programs built from one of the changed files whose
+	// expanded sources really differ. The old programs stay in use until update()
+	// swaps the new ones in. Returns the number of rebuilds started.
+	unsigned int reload(const std::vector<std::string>& changedFiles) {
+		unsigned int started = 0;
+		for (const auto& entry : programs) {
+			const std::vector<std::string>& files = entry.second->sourceFiles();
+			bool affected = std::any_of(changedFiles.begin(), changedFiles.end(), [&files](const std::string& file) {
+				return std::find(files.begin(), files.end(), file) != files.end();
+			});
+			if (!affected || !entry.second->sourcesChanged()) {
+				continue;
+			}
+			auto pending = reloads.find(entry.first);
+			if (pending != reloads.end()) {
+				//superseded by the newer edit
+				pending->second->waitUntilReady();
+				glDeleteProgram(pending->second->ID);
+			}
+			reloads[entry.first].reset(new Shader(entry.second->rebuilt(shaderCompiler)));
+			started++;
+		}
+		return started;
+	}
+
+	// Swaps in the rebuilt programs that finished. Every holder of the shared
+	// Shader sees the new program at once, so callers must set its uniforms
+	// again (Renderer::programsReloaded). A program that fails to compile is
+	// dropped and the previous one kept. Returns true if any program changed.
+	bool update() {
+		bool swapped = false;
+		for (auto reload = reloads.begin(); reload != reloads.end();) {
+			std::shared_ptr<Shader>& current = programs[reload->first];
+			if (!reload->second->isReady() || !current->isReady()) {
+				++reload;
+				continue;
+			}
+			if (reload->second->isLinked()) {
+				glDeleteProgram(current->ID);
+				*current = std::move(*reload->second);
+				swapped = true;
+			}
+			else {
+				std::cout << "ERROR::SHADER_RELOAD::keeping the previous program" << std::endl;
+				glDeleteProgram(reload->second->ID);
+			}
+			reload = reloads.erase(reload);
+		}
+		return swapped;
+	}
+
+	// summed GL_PROGRAM_BINARY_LENGTH of the finished programs, a rough measure of
+	// how much code the variants contain
+	GLint binaryBytes() const {
+		GLint total = 0;
+		for (const auto& entry : programs) {
+			GLint length = 0;
+			glGetProgramiv(entry.second->ID, GL_PROGRAM_BINARY_LENGTH, &length);
+			total += length;
+		}
+		return total;
+	}
+
+private:
+	ShaderCompiler* shaderCompiler;
+	bool specialize;
+	unsigned int bounceLimit;
+	bool nextEvent;
+	std::map<std::string, std::shared_ptr<Shader>> programs;
+	std::map<std::string, std::unique_ptr<Shader>> reloads;		//rebuilds in flight, by program key
+
+	template<class Create>
+	std::shared_ptr<Shader> find(const std::string& key, Create create) {
+		auto found = programs.find(key);
+		if (found != programs.end()) {
+			return found->second;
+		}
+		std::shared_ptr<Shader> shader(create(), [](Shader* shader) {
+			glDeleteProgram(shader->ID);
+			delete shader;
+		});
+		programs[key] = shader;
+		return shader;
+	}
+};
+
+#endif
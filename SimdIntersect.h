@@ -0,0 +1,560 @@
+#ifndef SIMD_INTERSECT_H
+#define SIMD_INTERSECT_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "CpuPathTracing.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_SSE __attribute__((target("sse2")))
+#else
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_SSE
+#endif
+
+enum class SimdLevel { Scalar, SSE, AVX2 };
+
+inline const char* simdLevelName(SimdLevel level) {
+	switch (level) {
+	case SimdLevel::AVX2: return "avx2";
+	case SimdLevel::SSE: return "sse";
+	default: return "scalar";
+	}
+}
+
+inline SimdLevel detectSimdLevel() {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5)) {
+			return SimdLevel::AVX2;
+		}
+	}
+	return SimdLevel::SSE;
+#elif defined(SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return SimdLevel::AVX2;
+	}
+	return __builtin_cpu_supports("sse2") ? SimdLevel::SSE : SimdLevel::Scalar;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+// Scene primitives in structure-of-arrays form. Every array is padded to a multiple
+// of 8 so the AVX2 and SSE loops never read past the end; padded lanes are masked
+// out by their index.
+struct SceneSoA {
+	static const unsigned int WIDTH = 8;
+
+	unsigned int sphereCount = 0;
+	unsigned int planeCount = 0;
+	std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+	std::vector<float> planeNX, planeNY, planeNZ;
+	std::vector<float> planePX, planePY, planePZ;
+	std::vector<float> planeLength, planeOffset;		//planeOffset = dot(normal, position)
+	std::vector<float> sphereIndex, planeIndex;			//lane indices as floats for blending
+
+	explicit SceneSoA(const Scene& scene) {
+		sphereCount = (unsigned int)scene.spheres.size();
+		planeCount = (unsigned int)scene.planes.size();
+		size_t spherePadded = (sphereCount + WIDTH - 1) / WIDTH * WIDTH;
+		size_t planePadded = (planeCount + WIDTH - 1) / WIDTH * WIDTH;
+		for (std::vector<float>* v : { &sphereX, &sphereY, &sphereZ, &sphereRadius, &sphereIndex }) {
+			v->assign(spherePadded, 0.0f);
+		}
+		for (std::vector<float>* v : { &planeNX, &planeNY, &planeNZ, &planePX, &planePY, &planePZ, &planeLength, &planeOffset, &planeIndex }) {
+			v->assign(planePadded, 0.0f);
+		}
+		for (size_t i = 0; i < spherePadded; i++) {
+			sphereIndex[i] = (float)i;
+		}
+		for (size_t i = 0; i < planePadded; i++) {
+			planeIndex[i] = (float)i;
+		}
+		for (unsigned int i = 0; i < sphereCount; i++) {
+			const Sphere& s = scene.spheres[i];
+			sphereX[i] = s.center.x;
+			sphereY[i] = s.center.y;
+			sphereZ[i] = s.center.z;
+			sphereRadius[i] = s.radius;
+		}
+		for (unsigned int i = 0; i < planeCount; i++) {
+			const Plane& p = scene.planes[i];
+			planeNX[i] = p.normal.x;
+			planeNY[i] = p.normal.y;
+			planeNZ[i] = p.normal.z;
+			planePX[i] = p.position.x;
+			planePY[i] = p.position.y;
+			planePZ[i] = p.position.z;
+			planeLength[i] = p.lenght;
+			planeOffset[i] = glm::dot(p.normal, p.position);
+		}
+	}
+};
+
+// index of the closest primitive: spheres first, then planes at sphereCount + i
+struct ClosestHit {
+	float t = 1e30f;
+	int primitive = -1;
+};
+
+inline void closestHitScalar(const SceneSoA& soa, const Ray& ray, ClosestHit& best) {
+	for (unsigned int i = 0; i < soa.sphereCount; i++) {
+		float tx = ray.pos.x - soa.sphereX[i];
+		float ty = ray.pos.y - soa.sphereY[i];
+		float tz = ray.pos.z - soa.sphereZ[i];
+		float a = ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z;
+		float b = 2 * (ray.dir.x * tx + ray.dir.y * ty + ray.dir.z * tz);
+		float tmp2 = tx * tx + ty * ty + tz * tz;
+		float r = soa.sphereRadius[i];
+		float c = tmp2 - r * r;
+		float delta = b * b - 4 * a * c;
+		if (delta >= 0.0f) {
+			float root = std::sqrt(delta);
+			float t = (std::sqrt(tmp2) < r ? (-b + root) : (-b - root)) / 2.0f * a;
+			if (t < best.t && t > 0.0f) {
+				best.t = t;
+				best.primitive = (int)i;
+			}
+		}
+	}
+	for (unsigned int i = 0; i < soa.planeCount; i++) {
+		float denominator = ray.dir.x * soa.planeNX[i] + ray.dir.y * soa.planeNY[i] + ray.dir.z * soa.planeNZ[i];
+		if (denominator != 0.0f) {
+			float t = (soa.planeOffset[i] - (ray.pos.x * soa.planeNX[i] + ray.pos.y * soa.planeNY[i] + ray.pos.z * soa.planeNZ[i])) / denominator;
+			float dx = ray.pos.x + t * ray.dir.x - soa.planePX[i];
+			float dy = ray.pos.y + t * ray.dir.y - soa.planePY[i];
+			float dz = ray.pos.z + t * ray.dir.z - soa.planePZ[i];
+			float len = soa.planeLength[i];
+			if (std::abs(dx) < len && std::abs(dy) < len && std::abs(dz) < len && t < best.t && t > 0.0f) {
+				best.t = t;
+				best.primitive = (int)(soa.sphereCount + i);
+			}
+		}
+	}
+}
+
+// Any hit over soa: true at the first primitive hit in (0, tMax), planes before
+// spheres, each in soa order. The tests are those of closestHitScalar.
+inline bool occludedScalar(const SceneSoA& soa, const Ray& ray, float tMax) {
+	for (unsigned int i = 0; i < soa.planeCount; i++) {
+		float denominator = ray.dir.x * soa.planeNX[i] + ray.dir.y * soa.planeNY[i] + ray.dir.z * soa.planeNZ[i];
+		if (denominator != 0.0f) {
+			float t = (soa.planeOffset[i] - (ray.pos.x * soa.planeNX[i] + ray.pos.y * soa.planeNY[i] + ray.pos.z * soa.planeNZ[i])) / denominator;
+			float dx = ray.pos.x + t * ray.dir.x - soa.planePX[i];
+			float dy = ray.pos.y + t * ray.dir.y - soa.planePY[i];
+			float dz = ray.pos.z + t * ray.dir.z - soa.planePZ[i];
+			float len = soa.planeLength[i];
+			if (std::abs(dx) < len && std::abs(dy) < len && std::abs(dz) < len && t < tMax && t > 0.0f) {
+				return true;
+			}
+		}
+	}
+	for (unsigned int i = 0; i < soa.sphereCount; i++) {
+		float tx = ray.pos.x - soa.sphereX[i];
+		float ty = ray.pos.y - soa.sphereY[i];
+		float tz = ray.pos.z - soa.sphereZ[i];
+		float a = ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z;
+		float b = 2 * (ray.dir.x * tx + ray.dir.y * ty + ray.dir.z * tz);
+		float tmp2 = tx * tx + ty * ty + tz * tz;
+		float r = soa.sphereRadius[i];
+		float c = tmp2 - r * r;
+		float delta = b * b - 4 * a * c;
+		if (delta >= 0.0f) {
+			float root = std::sqrt(delta);
+			float t = (std::sqrt(tmp2) < r ? (-b + root) : (-b - root)) / 2.0f * a;
+			if (t < tMax && t > 0.0f) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 inline void closestHitAVX2(const SceneSoA& soa, const Ray& ray, ClosestHit& best) {
+	const __m256 ox = _mm256_set1_ps(ray.pos.x), oy = _mm256_set1_ps(ray.pos.y), oz = _mm256_set1_ps(ray.pos.z);
+	const __m256 dx = _mm256_set1_ps(ray.dir.x), dy = _mm256_set1_ps(ray.dir.y), dz = _mm256_set1_ps(ray.dir.z);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 a = _mm256_set1_ps(ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z);
+	const __m256 fourA = _mm256_mul_ps(_mm256_set1_ps(4.0f), a);
+	alignas(32) float laneT[8];
+	alignas(32) float laneIndex[8];
+
+	__m256 bestT = _mm256_set1_ps(best.t);
+	__m256 bestIndex = _mm256_set1_ps(-1.0f);
+	const __m256 sphereCount = _mm256_set1_ps((float)soa.sphereCount);
+	for (size_t i = 0; i < soa.sphereX.size(); i += 8) {
+		__m256 index = _mm256_loadu_ps(&soa.sphereIndex[i]);
+		__m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(&soa.sphereX[i]));
+		__m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(&soa.sphereY[i]));
+		__m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(&soa.sphereZ[i]));
+		__m256 r = _mm256_loadu_ps(&soa.sphereRadius[i]);
+		__m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, tx), _mm256_mul_ps(dy, ty)), _mm256_mul_ps(dz, tz)));
+		__m256 tmp2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz));
+		__m256 c = _mm256_sub_ps(tmp2, _mm256_mul_ps(r, r));
+		__m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(fourA, c));
+		__m256 root = _mm256_sqrt_ps(_mm256_max_ps(delta, zero));
+		__m256 inside = _mm256_cmp_ps(_mm256_sqrt_ps(tmp2), r, _CMP_LT_OQ);
+		root = _mm256_xor_ps(root, _mm256_andnot_ps(inside, signMask));		//-root unless the origin is inside
+		__m256 t = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(root, b), two), a);
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(delta, zero, _CMP_GE_OQ), _mm256_cmp_ps(index, sphereCount, _CMP_LT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+		bestT = _mm256_blendv_ps(bestT, t, mask);
+		bestIndex = _mm256_blendv_ps(bestIndex, index, mask);
+	}
+	_mm256_store_ps(laneT, bestT);
+	_mm256_store_ps(laneIndex, bestIndex);
+	for (int i = 0; i < 8; i++) {
+		if (laneIndex[i] >= 0.0f && (laneT[i] < best.t || (laneT[i] == best.t && (int)laneIndex[i] < best.primitive))) {
+			best.t = laneT[i];
+			best.primitive = (int)laneIndex[i];
+		}
+	}
+
+	//planes are only accepted when strictly closer than every sphere hit, as in the shader
+	bestT = _mm256_set1_ps(best.t);
+	bestIndex = _mm256_set1_ps(-1.0f);
+	const __m256 planeCount = _mm256_set1_ps((float)soa.planeCount);
+	for (size_t i = 0; i < soa.planeNX.size(); i += 8) {
+		__m256 index = _mm256_loadu_ps(&soa.planeIndex[i]);
+		__m256 nx = _mm256_loadu_ps(&soa.planeNX[i]), ny = _mm256_loadu_ps(&soa.planeNY[i]), nz = _mm256_loadu_ps(&soa.planeNZ[i]);
+		__m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+		__m256 originDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, nx), _mm256_mul_ps(oy, ny)), _mm256_mul_ps(oz, nz));
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&soa.planeOffset[i]), originDistance), denominator);
+		__m256 len = _mm256_loadu_ps(&soa.planeLength[i]);
+		__m256 ex = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(ox, _mm256_mul_ps(t, dx)), _mm256_loadu_ps(&soa.planePX[i])));
+		__m256 ey = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oy, _mm256_mul_ps(t, dy)), _mm256_loadu_ps(&soa.planePY[i])));
+		__m256 ez = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oz, _mm256_mul_ps(t, dz)), _mm256_loadu_ps(&soa.planePZ[i])));
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(index, planeCount, _CMP_LT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(ex, len, _CMP_LT_OQ), _mm256_and_ps(_mm256_cmp_ps(ey, len, _CMP_LT_OQ), _mm256_cmp_ps(ez, len, _CMP_LT_OQ))));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, bestT, _CMP_LT_OQ)));
+		bestT = _mm256_blendv_ps(bestT, t, mask);
+		bestIndex = _mm256_blendv_ps(bestIndex, index, mask);
+	}
+	_mm256_store_ps(laneT, bestT);
+	_mm256_store_ps(laneIndex, bestIndex);
+	int planeBest = -1;
+	float planeT = best.t;
+	for (int i = 0; i < 8; i++) {
+		if (laneIndex[i] >= 0.0f && (laneT[i] < planeT || (laneT[i] == planeT && (int)laneIndex[i] < planeBest))) {
+			planeT = laneT[i];
+			planeBest = (int)laneIndex[i];
+		}
+	}
+	if (planeBest >= 0) {
+		best.t = planeT;
+		best.primitive = (int)soa.sphereCount + planeBest;
+	}
+}
+
+SIMD_TARGET_SSE inline __m128 blendSSE(__m128 a, __m128 b, __m128 mask) {
+	return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+}
+
+SIMD_TARGET_SSE inline void closestHitSSE(const SceneSoA& soa, const Ray& ray, ClosestHit& best) {
+	const __m128 ox = _mm_set1_ps(ray.pos.x), oy = _mm_set1_ps(ray.pos.y), oz = _mm_set1_ps(ray.pos.z);
+	const __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 a = _mm_set1_ps(ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z);
+	const __m128 fourA = _mm_mul_ps(_mm_set1_ps(4.0f), a);
+	alignas(16) float laneT[4];
+	alignas(16) float laneIndex[4];
+
+	__m128 bestT = _mm_set1_ps(best.t);
+	__m128 bestIndex = _mm_set1_ps(-1.0f);
+	const __m128 sphereCount = _mm_set1_ps((float)soa.sphereCount);
+	for (size_t i = 0; i < soa.sphereX.size(); i += 4) {
+		__m128 index = _mm_loadu_ps(&soa.sphereIndex[i]);
+		__m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(&soa.sphereX[i]));
+		__m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(&soa.sphereY[i]));
+		__m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(&soa.sphereZ[i]));
+		__m128 r = _mm_loadu_ps(&soa.sphereRadius[i]);
+		__m128 b = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, tx), _mm_mul_ps(dy, ty)), _mm_mul_ps(dz, tz)));
+		__m128 tmp2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+		__m128 c = _mm_sub_ps(tmp2, _mm_mul_ps(r, r));
+		__m128 delta = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(fourA, c));
+		__m128 root = _mm_sqrt_ps(_mm_max_ps(delta, zero));
+		__m128 inside = _mm_cmplt_ps(_mm_sqrt_ps(tmp2), r);
+		root = _mm_xor_ps(root, _mm_andnot_ps(inside, signMask));
+		__m128 t = _mm_mul_ps(_mm_div_ps(_mm_sub_ps(root, b), two), a);
+		__m128 mask = _mm_and_ps(_mm_cmpge_ps(delta, zero), _mm_cmplt_ps(index, sphereCount));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, bestT)));
+		bestT = blendSSE(bestT, t, mask);
+		bestIndex = blendSSE(bestIndex, index, mask);
+	}
+	_mm_store_ps(laneT, bestT);
+	_mm_store_ps(laneIndex, bestIndex);
+	for (int i = 0; i < 4; i++) {
+		if (laneIndex[i] >= 0.0f && (laneT[i] < best.t || (laneT[i] == best.t && (int)laneIndex[i] < best.primitive))) {
+			best.t = laneT[i];
+			best.primitive = (int)laneIndex[i];
+		}
+	}
+
+	bestT = _mm_set1_ps(best.t);
+	bestIndex = _mm_set1_ps(-1.0f);
+	const __m128 planeCount = _mm_set1_ps((float)soa.planeCount);
+	for (size_t i = 0; i < soa.planeNX.size(); i += 4) {
+		__m128 index = _mm_loadu_ps(&soa.planeIndex[i]);
+		__m128 nx = _mm_loadu_ps(&soa.planeNX[i]), ny = _mm_loadu_ps(&soa.planeNY[i]), nz = _mm_loadu_ps(&soa.planeNZ[i]);
+		__m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+		__m128 originDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz));
+		__m128 t = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(&soa.planeOffset[i]), originDistance), denominator);
+		__m128 len = _mm_loadu_ps(&soa.planeLength[i]);
+		__m128 ex = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(ox, _mm_mul_ps(t, dx)), _mm_loadu_ps(&soa.planePX[i])));
+		__m128 ey = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(oy, _mm_mul_ps(t, dy)), _mm_loadu_ps(&soa.planePY[i])));
+		__m128 ez = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(oz, _mm_mul_ps(t, dz)), _mm_loadu_ps(&soa.planePZ[i])));
+		__m128 mask = _mm_and_ps(_mm_cmpneq_ps(denominator, zero), _mm_cmplt_ps(index, planeCount));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(ex, len), _mm_and_ps(_mm_cmplt_ps(ey, len), _mm_cmplt_ps(ez, len))));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, bestT)));
+		bestT = blendSSE(bestT, t, mask);
+		bestIndex = blendSSE(bestIndex, index, mask);
+	}
+	_mm_store_ps(laneT, bestT);
+	_mm_store_ps(laneIndex, bestIndex);
+	int planeBest = -1;
+	float planeT = best.t;
+	for (int i = 0; i < 4; i++) {
+		if (laneIndex[i] >= 0.0f && (laneT[i] < planeT || (laneT[i] == planeT && (int)laneIndex[i] < planeBest))) {
+			planeT = laneT[i];
+			planeBest = (int)laneIndex[i];
+		}
+	}
+	if (planeBest >= 0) {
+		best.t = planeT;
+		best.primitive = (int)soa.sphereCount + planeBest;
+	}
+}
+
+// occludedScalar eight primitives at a time; returns after the first group with a hit
+SIMD_TARGET_AVX2 inline bool occludedAVX2(const SceneSoA& soa, const Ray& ray, float tMax) {
+	const __m256 ox = _mm256_set1_ps(ray.pos.x), oy = _mm256_set1_ps(ray.pos.y), oz = _mm256_set1_ps(ray.pos.z);
+	const __m256 dx = _mm256_set1_ps(ray.dir.x), dy = _mm256_set1_ps(ray.dir.y), dz = _mm256_set1_ps(ray.dir.z);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 maxT = _mm256_set1_ps(tMax);
+
+	const __m256 planeCount = _mm256_set1_ps((float)soa.planeCount);
+	for (size_t i = 0; i < soa.planeNX.size(); i += 8) {
+		__m256 index = _mm256_loadu_ps(&soa.planeIndex[i]);
+		__m256 nx = _mm256_loadu_ps(&soa.planeNX[i]), ny = _mm256_loadu_ps(&soa.planeNY[i]), nz = _mm256_loadu_ps(&soa.planeNZ[i]);
+		__m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+		__m256 originDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, nx), _mm256_mul_ps(oy, ny)), _mm256_mul_ps(oz, nz));
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(&soa.planeOffset[i]), originDistance), denominator);
+		__m256 len = _mm256_loadu_ps(&soa.planeLength[i]);
+		__m256 ex = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(ox, _mm256_mul_ps(t, dx)), _mm256_loadu_ps(&soa.planePX[i])));
+		__m256 ey = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oy, _mm256_mul_ps(t, dy)), _mm256_loadu_ps(&soa.planePY[i])));
+		__m256 ez = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_add_ps(oz, _mm256_mul_ps(t, dz)), _mm256_loadu_ps(&soa.planePZ[i])));
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(index, planeCount, _CMP_LT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(ex, len, _CMP_LT_OQ), _mm256_and_ps(_mm256_cmp_ps(ey, len, _CMP_LT_OQ), _mm256_cmp_ps(ez, len, _CMP_LT_OQ))));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, maxT, _CMP_LT_OQ)));
+		if (_mm256_movemask_ps(mask) != 0) {
+			return true;
+		}
+	}
+
+	const __m256 a = _mm256_set1_ps(ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z);
+	const __m256 fourA = _mm256_mul_ps(_mm256_set1_ps(4.0f), a);
+	const __m256 sphereCount = _mm256_set1_ps((float)soa.sphereCount);
+	for (size_t i = 0; i < soa.sphereX.size(); i += 8) {
+		__m256 index = _mm256_loadu_ps(&soa.sphereIndex[i]);
+		__m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(&soa.sphereX[i]));
+		__m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(&soa.sphereY[i]));
+		__m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(&soa.sphereZ[i]));
+		__m256 r = _mm256_loadu_ps(&soa.sphereRadius[i]);
+		__m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, tx), _mm256_mul_ps(dy, ty)), _mm256_mul_ps(dz, tz)));
+		__m256 tmp2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz));
+		__m256 c = _mm256_sub_ps(tmp2, _mm256_mul_ps(r, r));
+		__m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(fourA, c));
+		__m256 root = _mm256_sqrt_ps(_mm256_max_ps(delta, zero));
+		__m256 inside = _mm256_cmp_ps(_mm256_sqrt_ps(tmp2), r, _CMP_LT_OQ);
+		root = _mm256_xor_ps(root, _mm256_andnot_ps(inside, signMask));
+		__m256 t = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(root, b), two), a);
+		__m256 mask = _mm256_and_ps(_mm256_cmp_ps(delta, zero, _CMP_GE_OQ), _mm256_cmp_ps(index, sphereCount, _CMP_LT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, maxT, _CMP_LT_OQ)));
+		if (_mm256_movemask_ps(mask) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+SIMD_TARGET_SSE inline bool occludedSSE(const SceneSoA& soa, const Ray& ray, float tMax) {
+	const __m128 ox = _mm_set1_ps(ray.pos.x), oy = _mm_set1_ps(ray.pos.y), oz = _mm_set1_ps(ray.pos.z);
+	const __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 maxT = _mm_set1_ps(tMax);
+
+	const __m128 planeCount = _mm_set1_ps((float)soa.planeCount);
+	for (size_t i = 0; i < soa.planeNX.size(); i += 4) {
+		__m128 index = _mm_loadu_ps(&soa.planeIndex[i]);
+		__m128 nx = _mm_loadu_ps(&soa.planeNX[i]), ny = _mm_loadu_ps(&soa.planeNY[i]), nz = _mm_loadu_ps(&soa.planeNZ[i]);
+		__m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+		__m128 originDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz));
+		__m128 t = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(&soa.planeOffset[i]), originDistance), denominator);
+		__m128 len = _mm_loadu_ps(&soa.planeLength[i]);
+		__m128 ex = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(ox, _mm_mul_ps(t, dx)), _mm_loadu_ps(&soa.planePX[i])));
+		__m128 ey = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(oy, _mm_mul_ps(t, dy)), _mm_loadu_ps(&soa.planePY[i])));
+		__m128 ez = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_add_ps(oz, _mm_mul_ps(t, dz)), _mm_loadu_ps(&soa.planePZ[i])));
+		__m128 mask = _mm_and_ps(_mm_cmpneq_ps(denominator, zero), _mm_cmplt_ps(index, planeCount));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(ex, len), _mm_and_ps(_mm_cmplt_ps(ey, len), _mm_cmplt_ps(ez, len))));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, maxT)));
+		if (_mm_movemask_ps(mask) != 0) {
+			return true;
+		}
+	}
+
+	const __m128 a = _mm_set1_ps(ray.dir.x * ray.dir.x + ray.dir.y * ray.dir.y + ray.dir.z * ray.dir.z);
+	const __m128 fourA = _mm_mul_ps(_mm_set1_ps(4.0f), a);
+	const __m128 sphereCount = _mm_set1_ps((float)soa.sphereCount);
+	for (size_t i = 0; i < soa.sphereX.size(); i += 4) {
+		__m128 index = _mm_loadu_ps(&soa.sphereIndex[i]);
+		__m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(&soa.sphereX[i]));
+		__m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(&soa.sphereY[i]));
+		__m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(&soa.sphereZ[i]));
+		__m128 r = _mm_loadu_ps(&soa.sphereRadius[i]);
+		__m128 b = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, tx), _mm_mul_ps(dy, ty)), _mm_mul_ps(dz, tz)));
+		__m128 tmp2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+		__m128 c = _mm_sub_ps(tmp2, _mm_mul_ps(r, r));
+		__m128 delta = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(fourA, c));
+		__m128 root = _mm_sqrt_ps(_mm_max_ps(delta, zero));
+		__m128 inside = _mm_cmplt_ps(_mm_sqrt_ps(tmp2), r);
+		root = _mm_xor_ps(root, _mm_andnot_ps(inside, signMask));
+		__m128 t = _mm_mul_ps(_mm_div_ps(_mm_sub_ps(root, b), two), a);
+		__m128 mask = _mm_and_ps(_mm_cmpge_ps(delta, zero), _mm_cmplt_ps(index, sphereCount));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, maxT)));
+		if (_mm_movemask_ps(mask) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+#endif
+
+// The scene with its spheres and planes in the order Scene::spheresBySize and
+// Scene::planesBySize give, for the any hit kernels
+inline Scene occluderScene(const Scene& scene) {
+	Scene sorted;
+	for (unsigned int i : scene.spheresBySize()) {
+		sorted.spheres.push_back(scene.spheres[i]);
+	}
+	for (unsigned int i : scene.planesBySize()) {
+		sorted.planes.push_back(scene.planes[i]);
+	}
+	return sorted;
+}
+
+// Closest hit queries over a scene using the widest kernel the CPU supports.
+// Drop-in replacement for intersectRay in CpuPathTracing.h. Shadow rays use the any
+// hit query occluded, which runs over a copy of the primitives sorted largest first.
+class SimdIntersector {
+public:
+	SimdIntersector(const Scene& scene, SimdLevel requested) :
+		scene(scene),
+		soa(scene),
+		occluders(occluderScene(scene))
+	{
+		SimdLevel available = detectSimdLevel();
+		level = (int)requested <= (int)available ? requested : available;
+	}
+
+	SimdLevel simdLevel() const {
+		return level;
+	}
+
+	ClosestHit closestHit(const Ray& ray) const {
+		ClosestHit best;
+		switch (level) {
+#ifdef SIMD_X86
+		case SimdLevel::AVX2:
+			closestHitAVX2(soa, ray, best);
+			break;
+		case SimdLevel::SSE:
+			closestHitSSE(soa, ray, best);
+			break;
+#endif
+		default:
+			closestHitScalar(soa, ray, best);
+			break;
+		}
+		return best;
+	}
+
+	// fills hit the same way IntersectRay does for the winning primitive
+	bool resolve(const Ray& ray, const ClosestHit& best, HitInfo& hit) const {
+		hit.t = best.t;
+		if (best.primitive < 0) {
+			return false;
+		}
+		hit.position = ray.pos + best.t * ray.dir;
+		if (best.primitive < (int)soa.sphereCount) {
+			const Sphere& sphere = scene.spheres[best.primitive];
+			hit.normal = glm::normalize(hit.position - sphere.center);
+			hit.mtl = &sphere.mtl;
+		}
+		else {
+			const Plane& plane = scene.planes[best.primitive - soa.sphereCount];
+			hit.normal = plane.normal;
+			hit.mtl = &plane.mtl;
+		}
+		hit.frontFace = glm::dot(ray.dir, hit.normal) < 0.0f;
+		hit.normal = hit.frontFace ? hit.normal : -hit.normal;
+		return true;
+	}
+
+	bool operator()(const Ray& ray, HitInfo& hit) const {
+		return resolve(ray, closestHit(ray), hit);
+	}
+
+	// Occluded in the shader: whether anything lies on the ray closer than tMax
+	bool occluded(const Ray& ray, float tMax) const {
+		switch (level) {
+#ifdef SIMD_X86
+		case SimdLevel::AVX2:
+			return occludedAVX2(occluders, ray, tMax);
+		case SimdLevel::SSE:
+			return occludedSSE(occluders, ray, tMax);
+#endif
+		default:
+			return occludedScalar(occluders, ray, tMax);
+		}
+	}
+
+private:
+	const Scene& scene;
+	SceneSoA soa;
+	SceneSoA occluders;				//planes and spheres by decreasing size
+	SimdLevel level;
+};
+
+#endif
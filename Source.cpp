@@ -3,25 +3,38 @@
 #include <GLFW/glfw3.h>
 
 #include "Shader.h"
-#include "Sphere.h"
-#include "Plane.h"
-#include "Material.h"
-#include "Light.h"
+#include "Scene.h"
 #include "Camera.h"
+#include "Renderer.h"
+#include "CpuTracer.h"
+#include "Benchmark.h"
+#include "HeadlessContext.h"
+#include "Options.h"
+#include "Image.h"
+#include "FileWatcher.h"
+#include "GpuTimer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouseMovementCallback(GLFWwindow* window, double xpos, double ypos);
 
-const unsigned int SCR_WIDTH = 1280;
-const unsigned int SCR_HEIGHT = 720;
 float fov = 90.0f;
-float aspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+const unsigned int sliceTileSize = 64;	//--time-slice defaults
+const double sliceFrameTime = 12.0;
+const unsigned int adaptiveTileSize = 64;	//--adaptive default
+const unsigned int stopCheckPasses = 8;		//--tolerance: tracer passes between error estimates
+const unsigned int stopMinSamples = 16;		//samples per pixel before the estimate is trusted
+const double benchNextEventTolerance = 0.02;	//--bench-nee without --tolerance
 
 Camera camera(glm::vec3(1.5, 0, 30.0f));
 bool MovementTrigger = false;
@@ -30,16 +43,66 @@ bool MovementTrigger = false;
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
 
-glm::mat4 trans = glm::mat4(1.0f);
+Scene createScene(const RenderOptions& options);
+bool applyFileChanges(const RenderOptions& options, FileWatcher& watcher, ShaderLibrary& library, Renderer& renderer);
+bool needsCompileWorker(const RenderOptions& options);
+std::unique_ptr<ShaderCompiler> createHeadlessCompiler(const RenderOptions& options, const HeadlessContext& context, HeadlessContext& workerContext);
+int runHeadless(const RenderOptions& options);
+int benchmarkGpuTracers(const RenderOptions& options);
+int benchmarkShaderVariants(const RenderOptions& options);
+int benchmarkAdaptive(const RenderOptions& options);
+int benchmarkNextEvent(const RenderOptions& options);
+std::unique_ptr<AdaptiveSampler> createAdaptiveSampler(const RenderOptions& options, ShaderLibrary& library);
+unsigned int traceSamples(Renderer& renderer, const glm::mat4& view, unsigned int samples, SampleBatch& batch, AdaptiveSampler* sampler = nullptr);
+std::vector<unsigned char> readResolved(Renderer& renderer);
+
+struct StopResult {
+    unsigned int passes;
+    unsigned int samples;		//per pixel, on average with adaptive sampling
+    double error;				//estimated relative RMSE when it stopped
+    bool converged;				//false if the time budget ran out first
+};
+StopResult traceUntilStopped(Renderer& renderer, const glm::mat4& view, const RenderOptions& options, SampleBatch& batch,
+    AdaptiveSampler* sampler, TileStatistics& statistics);
+void setConvergence(const RenderOptions& options, Renderer& renderer);
+void printConvergence(const Renderer& renderer, const RenderOptions& options, double seconds);
+void printSampleCounts(const Renderer& renderer);
+void printThroughput(const RenderOptions& options, unsigned int samples, double seconds);
+void printWorkerStats(const std::vector<WorkerStats>& stats, bool perThread);
+
+int main(int argc, char** argv) {
+    RenderOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return -1;
+    }
+    Shader::setBinaryCacheDirectory(options.shaderCache);
+    if (options.benchIntersect) {
+        benchmarkIntersection(camera.GetViewMatrix(), fov);
+        return 0;
+    }
+    if (options.benchTracers) {
+        return benchmarkGpuTracers(options);
+    }
+    if (options.benchVariants) {
+        return benchmarkShaderVariants(options);
+    }
+    if (options.benchAdaptive) {
+        return benchmarkAdaptive(options);
+    }
+    if (options.benchNextEvent) {
+        return benchmarkNextEvent(options);
+    }
+    if (options.headless) {
+        return runHeadless(options);
+    }
 
-int main() {
     #pragma region OpenGL Initializaion
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Path Tracer", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(options.width, options.height, "Path Tracer", NULL, NULL);
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -57,212 +120,716 @@ int main() {
         return -1;
     }
 
-    glEnable(GL_DEPTH_TEST);
     #pragma endregion
 
-    Shader tracerShader("VertexShader.vs", "FragmentShader.fs");
-    Shader viewShader("VertexShader.vs", "ViewFragmentShader.fs");
+    //hidden window whose context shares objects with the main one, for the compile thread
+    GLFWwindow* compileWindow = NULL;
+    WorkerContext compileContext;
+    if (needsCompileWorker(options)) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        compileWindow = glfwCreateWindow(1, 1, "", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (compileWindow != NULL) {
+            compileContext.makeCurrent = [compileWindow]() { glfwMakeContextCurrent(compileWindow); return true; };
+            compileContext.release = []() { glfwMakeContextCurrent(NULL); };
+        }
+    }
 
-    float ff = tan(glm::radians(fov * 0.5f));
-    float vertices[] = {
-        -aspectRatio*ff,  ff, -1.0,
-         aspectRatio*ff,  ff, -1.0,
-         aspectRatio*ff, -ff, -1.0,
-        -aspectRatio*ff, -ff, -1.0
-    };
-    int indices[] = {
-        0, 1, 2,
-        0, 2, 3
-    };
+    GLint originalFrameBuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &originalFrameBuffer);
+    {
+        ShaderCompiler compiler(options.shaderCompile, compileContext);
+        std::cout << "Shader compile: " << compiler.modeName() << std::endl;
+        ShaderLibrary library(&compiler, !options.uberShader, options.maxBounce, options.nextEvent);
+        Renderer renderer(options.width, options.height, fov, createScene(options), options.tracer, options.workgroup, &library);
+        renderer.setTileSize(options.tileSize);
+        renderer.setPersistentGroups(options.persistentGroups);
+        setConvergence(options, renderer);
+        if (!renderer.isComplete()) {
+            glfwTerminate();
+            return -1;
+        }
+        FileWatcher watcher;
+        if (options.watch) {
+            std::cout << "Watching shader files" << (options.scene.empty() ? "" : " and " + options.scene)
+                << (watcher.usesInotify() ? " (inotify)" : " (polling)") << std::endl;
+        }
 
-    glm::mat4 proj = glm::mat4(1.0f);
-    proj = glm::perspective(glm::radians(fov * 0.5f), aspectRatio, 0.1f, 100.0f);
-    tracerShader.use();
-    tracerShader.setMat4("proj", proj);
-    tracerShader.setFloat("view_pixel_width", (float)(2.0f * aspectRatio * ff / SCR_WIDTH));
-    tracerShader.setFloat("view_pixel_height", (float)(2.0f * ff / SCR_HEIGHT));
-
-    unsigned int VAO,VBO,EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    #pragma region Spheres
-    const int sphereCount = 7;
-    Sphere sphereList[sphereCount] = {
-            Sphere(glm::vec3(0.0f, 0.0f, 0.0f), 2.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))),      //metallic1
-            Sphere(glm::vec3(6.0f, -0.5f, 4.0f), 1.5f, Material(false, true, glm::vec3(1.0f, 0.7f, 0.4f))),     //metallic2
-            Sphere(glm::vec3(1.0f, -1.5f, 5.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 0.0f, 0.0f))),     //red
-            Sphere(glm::vec3(-2.0f, -1.0f, 6.0f), 1.0f, Material(true, false, glm::vec3(0.9f, 0.5f, 0.9f))),    //purple pink
-            Sphere(glm::vec3(3.0f, -1.0f, 4.0f), 1.0f, Material(true, false, glm::vec3(0.0f, 1.0f, 0.0f))),     //green
-            Sphere(glm::vec3(4.5f, -1.5f, 8.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 0.6f, 0.5f))),     //mellow pink
-            Sphere(glm::vec3(-3.0f, -1.5f, 8.0f), 0.5f, Material(true, false, glm::vec3(1.0f, 1.0f, 0.0f))),    //yellow
-    };
-    tracerShader.use();
-    for (int i = 0; i < sphereCount; i++) {
-        tracerShader.setVec3("spheres[" + std::to_string(i) + "].center", sphereList[i].center);
-        tracerShader.setFloat("spheres[" + std::to_string(i) + "].radius",sphereList[i].radius);
-        tracerShader.setBool("spheres[" + std::to_string(i) + "].mtl.diffuse", sphereList[i].mtl.diffuse);
-        tracerShader.setBool("spheres[" + std::to_string(i) + "].mtl.metallic", sphereList[i].mtl.metallic);
-        tracerShader.setVec3("spheres[" + std::to_string(i) + "].mtl.attenuation", sphereList[i].mtl.attenuation);
+        //time slicing steers the tiles per frame instead of the samples per pass
+        std::unique_ptr<TileProgress> progress;
+        SampleBatch batch(options.samplesPerPass, options.frameTime);
+        if (options.timeSlice) {
+            progress.reset(new TileProgress(options.width, options.height, options.tileSize > 0 ? options.tileSize : sliceTileSize));
+            batch = SampleBatch(1, options.frameTime > 0.0 ? options.frameTime : sliceFrameTime, progress->tileCount());
+            std::cout << "Time slicing " << progress->tileCount() << " tiles of " << progress->size() << "x" << progress->size() << std::endl;
+        }
+        std::unique_ptr<AdaptiveSampler> sampler = progress ? nullptr : createAdaptiveSampler(options, library);
+        GpuTimer tracerTimer;
+        unsigned int sampleCount = 0;
+        while (!glfwWindowShouldClose(window))
+        {
+            processInput(window);
+
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            //tracer pass times of earlier frames whose results are in by now
+            double passMs;
+            unsigned int passSamples;
+            while (tracerTimer.collect(passMs, passSamples)) {
+                batch.frameFinished(passSamples, passMs);
+            }
+
+            if (options.watch && applyFileChanges(options, watcher, library, renderer)) {
+                //restart the accumulation like a camera move
+                MovementTrigger = true;
+            }
+
+            bool cameraIsMoving = MovementTrigger;
+            if (MovementTrigger) {
+                sampleCount = 0;
+                if (progress) {
+                    progress->reset();
+                }
+                MovementTrigger = false;
+            }
+
+            if (renderer.isReady() && progress) {
+                unsigned int tiles = batch.samples();
+                bool timed = tracerTimer.begin();
+                renderer.traceTiles(camera.GetViewMatrix(), *progress, tiles, options.samplesPerPass);
+                if (timed) {
+                    tracerTimer.end(tiles);
+                }
+                //tiles not traced since the last camera move show the preview
+                if (!progress->complete()) {
+                    renderer.preview(originalFrameBuffer, camera.GetViewMatrix());
+                }
+                renderer.resolve(originalFrameBuffer);
+            }
+            else if (renderer.isReady()) {
+                //first pass
+                unsigned int samples = batch.samples();
+                bool timed = batch.adaptive() && tracerTimer.begin();
+                bool restart = cameraIsMoving || sampleCount == 0;
+                if (sampler) {
+                    renderer.traceAdaptive(camera.GetViewMatrix(), restart, *sampler, samples);
+                }
+                else {
+                    renderer.traceFrame(camera.GetViewMatrix(), restart, samples);
+                }
+                if (timed) {
+                    tracerTimer.end(samples);
+                }
+                sampleCount += samples;
+                //second pass
+                renderer.resolve(originalFrameBuffer);
+            }
+            else {
+                //the tracer is still compiling; accumulation starts with the first traced frame
+                renderer.preview(originalFrameBuffer, camera.GetViewMatrix());
+                sampleCount = 0;
+                if (progress) {
+                    progress->reset();
+                }
+            }
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
-    #pragma endregion
 
-    #pragma region Planes  
-    const int planeCount = 5;
-    Plane planes[planeCount] = {
-        Plane(glm::vec3(0,1.0f,0), glm::vec3(0,-2.0f,0), 100.0f, Material(true, false, glm::vec3(0.5f, 0.5f, 0.5f))),  //ground
-        Plane(glm::vec3(0.7071067f,0.0f,0.7071067f), glm::vec3(-5.0f,0,0), 5.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))), //mirror1
-        Plane(glm::vec3(0.7071067f,0.0f,0.7071067f), glm::vec3(-5.0f,0,0), 5.5f, Material(true, false, glm::vec3(0.4f, 0.3f, 0.9f))), //background
-        Plane(glm::vec3(-0.7071067f,0.0f,0.7071067f), glm::vec3(5,0,-8.0f), 10.0f, Material(false, true, glm::vec3(1.0f, 1.0f, 1.0f))), //mirror
-        Plane(glm::vec3(-0.7071067f,0.0f,0.7071067f), glm::vec3(5,0,-8.0f), 10.5f, Material(true, false, glm::vec3(0.9f, 1.0f, 0.8f))), //background
-    };
-    tracerShader.use();
-    for (int i = 0; i < planeCount; i++) {
-        tracerShader.setVec3("planes[" + std::to_string(i) + "].normal", planes[i].normal);
-        tracerShader.setVec3("planes[" + std::to_string(i) + "].position", planes[i].position);
-        tracerShader.setFloat("planes[" + std::to_string(i) + "].lenght", planes[i].lenght);
-        tracerShader.setBool("planes[" + std::to_string(i) + "].mtl.diffuse", planes[i].mtl.diffuse);
-        tracerShader.setBool("planes[" + std::to_string(i) + "].mtl.metallic", planes[i].mtl.metallic);
-        tracerShader.setVec3("planes[" + std::to_string(i) + "].mtl.attenuation", planes[i].mtl.attenuation);
+    glfwTerminate();
+    return 0;
+}
+
+// the --scene file or the default scene, with --extra-spheres small diffuse spheres added for scaling tests
+Scene createScene(const RenderOptions& options) {
+    Scene scene = Scene::createDefault();
+    if (!options.scene.empty() && !Scene::load(options.scene, scene)) {
+        std::cout << "Using the default scene" << std::endl;
     }
-    #pragma endregion
+    addBenchmarkSpheres(scene, options.extraSpheres);
+    return scene;
+}
 
-    #pragma region light sources  
-    const int lightCount = 1;
-    Light lights[lightCount] = {
-        Light(glm::vec3(0.0f, 10.0f, 15.0f), glm::vec3(1.0f,1.0f,1.0f))
-    };
-    tracerShader.use();
-    for (int i = 0; i < lightCount; i++) {
-        tracerShader.setVec3("lights[" + std::to_string(i) + "].position", lights[i].position);
-        tracerShader.setVec3("lights[" + std::to_string(i) + "].intensity", lights[i].intensity);
+// Hot reload for --watch: edited shader files are rebuilt in the background and
+// swapped in once compiled, an edited --scene file is applied to the scene buffers.
+// Returns true if the image changed, so the accumulated samples must be dropped.
+bool applyFileChanges(const RenderOptions& options, FileWatcher& watcher, ShaderLibrary& library, Renderer& renderer) {
+    //programs can be added (e.g. a new variant after a scene edit), so keep their files watched
+    for (const std::string& file : library.sourceFiles()) {
+        watcher.watch(file);
+    }
+    if (!options.scene.empty()) {
+        watcher.watch(options.scene);
     }
-    #pragma endregion
 
-    #pragma region Render to Buffer
-    GLint originalFrameBuffer;
-    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &originalFrameBuffer);
-    //CREATE FRAME BUFFER
-    float textureWidth = SCR_WIDTH;
-    float textureHeight = SCR_HEIGHT;
-    GLuint frameBuffer = 0;
-    glGenFramebuffers(1, &frameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-    //CREATE TEXTURE
-    GLuint renderedTexture;
-    glGenTextures(1, &renderedTexture);
-    glBindTexture(GL_TEXTURE_2D, renderedTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, textureWidth, textureHeight, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    //CREATE DEPTH BUFFER
-    GLuint depthBuffer;
-    glGenRenderbuffers(1, &depthBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, textureWidth, textureHeight);
-    //CONFIGURE FRAME BUFFER
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, renderedTexture, 0);
-    GLenum drawbuffers[1] = { GL_COLOR_ATTACHMENT0 };
-    glDrawBuffers(1, drawbuffers);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    bool changed = false;
+    std::vector<std::string> files = watcher.poll();
+    if (!options.scene.empty() && std::find(files.begin(), files.end(), options.scene) != files.end()) {
+        Scene scene;
+        if (Scene::load(options.scene, scene)) {
+            addBenchmarkSpheres(scene, options.extraSpheres);
+            changed = renderer.updateScene(scene);
+            std::cout << "Reloaded " << options.scene << (changed ? "" : ", no change") << std::endl;
+        }
+    }
+    if (!files.empty() && library.reload(files) > 0) {
+        std::cout << "Recompiling shaders" << std::endl;
+    }
+    if (library.update()) {
+        renderer.programsReloaded();
+        std::cout << "Shaders reloaded" << std::endl;
+        changed = true;
+    }
+    return changed;
+}
+
+// the thread fallback needs a second context, made before the compiler starts
+bool needsCompileWorker(const RenderOptions& options) {
+    return options.shaderCompile == CompileMode::Thread ||
+        (options.shaderCompile == CompileMode::Parallel && !ShaderCompiler::hasParallelCompile());
+}
+
+std::unique_ptr<ShaderCompiler> createHeadlessCompiler(const RenderOptions& options, const HeadlessContext& context, HeadlessContext& workerContext) {
+    WorkerContext worker;
+    if (needsCompileWorker(options) && workerContext.createShared(context)) {
+        worker.makeCurrent = [&workerContext]() { return workerContext.makeCurrent(); };
+        worker.release = [&workerContext]() { workerContext.release(); };
+    }
+    std::unique_ptr<ShaderCompiler> compiler(new ShaderCompiler(options.shaderCompile, worker));
+    std::cout << "Shader compile: " << compiler->modeName() << std::endl;
+    return compiler;
+}
+
+bool createHeadlessGL(HeadlessContext& context) {
+    if (!context.create()) {
         return false;
     }
-    #pragma endregion
+    if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << " | OpenGL " << glGetString(GL_VERSION) << std::endl;
+    return true;
+}
 
-    unsigned int loopCount = 0;
-    viewShader.use();
-    viewShader.setMat4("proj", proj);
-    viewShader.setUInt("width", SCR_WIDTH);
-    viewShader.setUInt("height", SCR_HEIGHT);
+bool renderGpu(const RenderOptions& options, std::vector<unsigned char>& pixels) {
+    HeadlessContext context;
+    if (!createHeadlessGL(context)) {
+        return false;
+    }
+    HeadlessContext workerContext;
+    std::unique_ptr<ShaderCompiler> compiler = createHeadlessCompiler(options, context, workerContext);
+    ShaderLibrary library(compiler.get(), !options.uberShader, options.maxBounce, options.nextEvent);
+
+    Renderer renderer(options.width, options.height, fov, createScene(options), options.tracer, options.workgroup, &library);
+    renderer.setTileSize(options.tileSize);
+    renderer.setPersistentGroups(options.persistentGroups);
+    if (options.tracer == TracerType::Persistent) {
+        std::cout << "Tracer: persistent, " << renderer.persistentGroupCount() << " workgroups of " << options.workgroup.x * options.workgroup.y << std::endl;
+    }
+    if (options.tracer == TracerType::Wavefront) {
+        std::cout << "Tracer: wavefront, " << GpuWavefront::WORKGROUP_SIZE << " rays per workgroup" << std::endl;
+    }
+    if (options.tracer == TracerType::Compute) {
+        std::cout << "Tracer: compute, " << options.workgroup.x << "x" << options.workgroup.y << " workgroups";
+        if (options.tileSize > 0) {
+            std::cout << ", " << options.tileSize << "x" << options.tileSize << " tiles";
+        }
+        std::cout << std::endl;
+    }
+    setConvergence(options, renderer);
+    if (!renderer.isComplete()) {
+        std::cout << "ERROR::HEADLESS::Accumulation framebuffer is incomplete" << std::endl;
+        return false;
+    }
+    std::unique_ptr<AdaptiveSampler> sampler = createAdaptiveSampler(options, library);
+
+    glm::mat4 view = camera.GetViewMatrix();
+    renderer.waitUntilReady();
+    if (sampler) {
+        sampler->waitUntilReady();
+    }
+    glFinish();
+    //--tolerance and --time-budget replace the fixed sample count
+    std::unique_ptr<TileStatistics> statistics;
+    if (options.tolerance > 0.0 || options.timeBudget > 0.0) {
+        statistics.reset(new TileStatistics(options.width, options.height, adaptiveTileSize, library));
+        statistics->waitUntilReady();
+    }
+    SampleBatch batch(options.samplesPerPass, options.frameTime);
+    auto start = std::chrono::steady_clock::now();
+    StopResult stop = { 0, options.samples, 0.0, false };
+    if (statistics) {
+        stop = traceUntilStopped(renderer, view, options, batch, sampler.get(), *statistics);
+    }
+    else {
+        stop.passes = traceSamples(renderer, view, options.samples, batch, sampler.get());
+    }
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << stop.passes << " tracer passes, " << batch.samples() << " samples per pixel in the last full one";
+    if (batch.adaptive()) {
+        std::cout << ", " << batch.sampleMs() << " GPU ms per sample";
+    }
+    std::cout << std::endl;
+    printThroughput(options, stop.samples, seconds);
+    if (statistics) {
+        std::cout << "Stopped at " << stop.samples << " samples per pixel after " << seconds << " s, estimated relative RMSE " << stop.error;
+        if (stop.converged) {
+            std::cout << " (tolerance " << options.tolerance << ")" << std::endl;
+        }
+        else {
+            std::cout << " (time budget of " << options.timeBudget << " s used up)" << std::endl;
+        }
+    }
+    if (options.converge > 0.0f) {
+        printConvergence(renderer, options, seconds);
+    }
+    if (sampler) {
+        printSampleCounts(renderer);
+    }
 
-    tracerShader.use();
-    tracerShader.setUInt("width", SCR_WIDTH);
-    tracerShader.setUInt("height", SCR_HEIGHT);
-    //******************
+    pixels = readResolved(renderer);
+    return true;
+}
 
-    glm::mat4 view = glm::mat4(1.0);
-    glm::vec2 randomVector_primary;
-    glm::vec2 randomVector_scatter;
+// the view pass into an 8-bit target, since headless there is no default framebuffer
+std::vector<unsigned char> readResolved(Renderer& renderer) {
+    GLuint resolveFrameBuffer, resolveTexture;
+    glGenFramebuffers(1, &resolveFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, resolveFrameBuffer);
+    glGenTextures(1, &resolveTexture);
+    glBindTexture(GL_TEXTURE_2D, resolveTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, renderer.width, renderer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, resolveTexture, 0);
+
+    renderer.resolve(resolveFrameBuffer);
+    std::vector<unsigned char> pixels((size_t)renderer.width * renderer.height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFrameBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, renderer.width, renderer.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    glDeleteTextures(1, &resolveTexture);
+    glDeleteFramebuffers(1, &resolveFrameBuffer);
+    return pixels;
+}
 
-    while (!glfwWindowShouldClose(window))
-    {
-        processInput(window);
-        loopCount++;
-
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        //first pass
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
-        glViewport(0, 0, textureWidth, textureHeight);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        tracerShader.use();
-        if (MovementTrigger) {
-            loopCount = 1;    
-            tracerShader.setBool("cameraIsMoving", true);
-            MovementTrigger = false;
+// Offline renders sized by quality: traces until the estimated relative RMSE of the
+// image (TileStatistics::relativeError) is at most options.tolerance or
+// options.timeBudget seconds have passed, whichever is set and comes first. The
+// estimate is read back every stopCheckPasses passes, which is also how often the
+// budget is checked, and the tolerance only counts from stopMinSamples samples on.
+StopResult traceUntilStopped(Renderer& renderer, const glm::mat4& view, const RenderOptions& options, SampleBatch& batch,
+    AdaptiveSampler* sampler, TileStatistics& statistics) {
+    StopResult result = { 0, 0, 0.0, false };
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        unsigned int samples = batch.samples() * stopCheckPasses;
+        result.passes += traceSamples(renderer, view, samples, batch, sampler);
+        result.samples += samples;
+        renderer.readStatistics(statistics);
+        result.error = statistics.relativeError();
+        result.converged = options.tolerance > 0.0 && result.samples >= stopMinSamples && result.error <= options.tolerance;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (result.converged || (options.timeBudget > 0.0 && seconds >= options.timeBudget)) {
+            return result;
         }
-        else{
-            tracerShader.setBool("cameraIsMoving", false);
+    }
+}
+
+// the --adaptive sampler, or null without it or for a tracer that cannot trace tiles
+std::unique_ptr<AdaptiveSampler> createAdaptiveSampler(const RenderOptions& options, ShaderLibrary& library) {
+    if (!options.adaptive) {
+        return nullptr;
+    }
+    if (options.tracer != TracerType::Fragment && options.tracer != TracerType::Compute) {
+        std::cout << "ERROR::ADAPTIVE::The " << (options.tracer == TracerType::Wavefront ? "wavefront" : "persistent")
+            << " tracer cannot trace tiles, sampling uniformly" << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<AdaptiveSampler> sampler(new AdaptiveSampler(options.width, options.height,
+        options.tileSize > 0 ? options.tileSize : adaptiveTileSize, library));
+    std::cout << "Adaptive sampling " << sampler->tileCount() << " tiles of " << sampler->size() << "x" << sampler->size()
+        << ", error estimated every " << AdaptiveSampler::INTERVAL << " passes" << std::endl;
+    return sampler;
+}
+
+// Adds samples paths per pixel to the accumulation in passes of batch.samples() each,
+// the last one shortened to land on the count. With a target time the passes are
+// timed with GPU queries so the batch can adapt. With a sampler the paths are spread
+// over its tiles and samples is the average over the image. Returns the number of passes.
+unsigned int traceSamples(Renderer& renderer, const glm::mat4& view, unsigned int samples, SampleBatch& batch, AdaptiveSampler* sampler) {
+    GpuTimer timer;
+    double passMs;
+    unsigned int passSamples;
+    unsigned int passes = 0;
+    double pixels = (double)renderer.width * renderer.height;
+    double paths = samples * pixels;
+    for (double traced = 0.0; traced < paths; passes++) {
+        //without frames to keep smooth, wait for the oldest result rather than run untimed
+        if (batch.adaptive() && timer.pending() == GpuTimer::RING_SIZE && timer.collect(passMs, passSamples, true)) {
+            batch.frameFinished(passSamples, passMs);
+        }
+        unsigned int pass = std::min(batch.samples(), (unsigned int)std::ceil((paths - traced) / pixels));
+        bool timed = batch.adaptive() && timer.begin();
+        if (sampler) {
+            traced += renderer.traceAdaptive(view, false, *sampler, pass);
+        }
+        else {
+            renderer.traceFrame(view, false, pass);
+            traced += pass * pixels;
+        }
+        if (timed) {
+            timer.end(pass);
+        }
+        while (timer.collect(passMs, passSamples)) {
+            batch.frameFinished(passSamples, passMs);
         }
-        
-        view = camera.GetViewMatrix();
-        tracerShader.setMat4("c2w", glm::inverse(view));
-        tracerShader.setVec3("cameraPos", camera.getCameraPosition());
-        randomVector_primary = glm::vec2(rand() / (RAND_MAX + 1.0), rand() / (RAND_MAX + 1.0));
-        randomVector_scatter = glm::vec2(rand() / (RAND_MAX + 1.0), rand() / (RAND_MAX + 1.0));
-        tracerShader.setVec2("randomVector", glm::vec2(rand() / (RAND_MAX + 1.0), rand() / (2 * (RAND_MAX + 1.0))));
+    }
+    return passes;
+}
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, renderedTexture);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+void setConvergence(const RenderOptions& options, Renderer& renderer) {
+    if (options.converge <= 0.0f) {
+        return;
+    }
+    if (renderer.setConvergence(options.converge)) {
+        std::cout << "Pixels stop at " << options.converge * 100.0f << "% relative error, checked every "
+            << ConvergenceMask::INTERVAL << " passes" << std::endl;
+    }
+    else {
+        std::cout << "ERROR::CONVERGENCE::The " << (options.tracer == TracerType::Wavefront ? "wavefront" : "persistent")
+            << " tracer cannot skip pixels, tracing all of them" << std::endl;
+    }
+}
 
+// how much of the full sample budget the convergence mask saved
+void printConvergence(const Renderer& renderer, const RenderOptions& options, double seconds) {
+    std::vector<float> accumulation = renderer.readAccumulation();
+    double paths = 0.0;
+    size_t stopped = 0;
+    for (size_t i = 3; i < accumulation.size(); i += 4) {
+        paths += accumulation[i];
+        stopped += accumulation[i] < options.samples ? 1 : 0;
+    }
+    size_t pixels = accumulation.size() / 4;
+    std::cout << "Converged early: " << 100.0 * stopped / pixels << "% of the pixels, " << 100.0 * paths / ((double)pixels * options.samples)
+        << "% of the paths traced, " << paths / seconds / 1e6 << " Mpaths/sec" << std::endl;
+}
 
-        //second pass
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, originalFrameBuffer);
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// how unevenly the samples ended up spread over the pixels
+void printSampleCounts(const Renderer& renderer) {
+    std::vector<float> accumulation = renderer.readAccumulation();
+    float lowest = accumulation[3], highest = accumulation[3];
+    double paths = 0.0;
+    for (size_t i = 3; i < accumulation.size(); i += 4) {
+        lowest = std::min(lowest, accumulation[i]);
+        highest = std::max(highest, accumulation[i]);
+        paths += accumulation[i];
+    }
+    std::cout << "Samples per pixel: " << lowest << " to " << highest << ", " << paths / (accumulation.size() / 4) << " on average" << std::endl;
+}
 
-        viewShader.use();
-        viewShader.setMat4("c2w", glm::inverse(view));
-        viewShader.setUInt("count", loopCount);
+const struct GpuTracerName { TracerType type; const char* name; } gpuTracers[] = {
+    { TracerType::Fragment, "fragment" },
+    { TracerType::Compute, "compute" },
+    { TracerType::Wavefront, "wavefront" },
+    { TracerType::Persistent, "persistent" }
+};
+
+// renders options.samples frames with every GPU tracer pass and prints their throughput side by side
+int benchmarkGpuTracers(const RenderOptions& options) {
+    HeadlessContext context;
+    if (!createHeadlessGL(context)) {
+        return -1;
+    }
+    HeadlessContext workerContext;
+    std::unique_ptr<ShaderCompiler> compiler = createHeadlessCompiler(options, context, workerContext);
+    ShaderLibrary library(compiler.get(), !options.uberShader, options.maxBounce, options.nextEvent);
+
+    //all tracer programs are started first so they compile at the same time
+    auto compileStart = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<Renderer>> renderers;
+    for (const auto& tracer : gpuTracers) {
+        renderers.emplace_back(new Renderer(options.width, options.height, fov, createScene(options), tracer.type, options.workgroup, &library));
+    }
+    for (auto& renderer : renderers) {
+        renderer->waitUntilReady();
+    }
+    std::cout << "All tracers compiled in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count() << " ms" << std::endl;
+
+    glm::mat4 view = camera.GetViewMatrix();
+    double paths = (double)options.samples * options.width * options.height;
+    std::cout << options.width << "x" << options.height << ", " << options.samples << " samples per tracer" << std::endl;
+    for (size_t i = 0; i < renderers.size(); i++) {
+        const auto& tracer = gpuTracers[i];
+        Renderer& renderer = *renderers[i];
+        renderer.setTileSize(options.tileSize);
+        renderer.setPersistentGroups(options.persistentGroups);
+        //one untimed frame so first-use costs are not measured
+        renderer.traceFrame(view, true);
+        glFinish();
+        SampleBatch batch(options.samplesPerPass, options.frameTime);
+        auto start = std::chrono::steady_clock::now();
+        traceSamples(renderer, view, options.samples, batch);
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::left << std::setw(12) << tracer.name << std::right << std::setw(10) << paths / seconds / 1e6 << " Mpaths/sec" << std::endl;
+    }
+    return 0;
+}
 
+// Builds every GPU tracer as the uber shader and as the variant specialized for the
+// scene, then prints compile time, program binary size and throughput of each.
+// Run with --shader-cache off to measure compilation.
+int benchmarkShaderVariants(const RenderOptions& options) {
+    HeadlessContext context;
+    if (!createHeadlessGL(context)) {
+        return -1;
+    }
+    HeadlessContext workerContext;
+    std::unique_ptr<ShaderCompiler> compiler = createHeadlessCompiler(options, context, workerContext);
+
+    Scene scene = createScene(options);
+    glm::mat4 view = camera.GetViewMatrix();
+    double paths = (double)options.samples * options.width * options.height;
+    std::cout << options.width << "x" << options.height << ", " << options.samples << " samples, " << scene.spheres.size() << " spheres, "
+        << scene.planes.size() << " planes, max bounce " << options.maxBounce << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "tracer" << std::setw(14) << "variant" << std::right << std::setw(12) << "compile ms"
+        << std::setw(12) << "binary KB" << std::setw(14) << "Mpaths/sec" << std::endl;
+    for (const auto& tracer : gpuTracers) {
+        for (bool specialize : { false, true }) {
+            ShaderLibrary library(compiler.get(), specialize, options.maxBounce, options.nextEvent);
+            auto compileStart = std::chrono::steady_clock::now();
+            Renderer renderer(options.width, options.height, fov, scene, tracer.type, options.workgroup, &library);
+            renderer.setTileSize(options.tileSize);
+            renderer.setPersistentGroups(options.persistentGroups);
+            renderer.waitUntilReady();
+            double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+            renderer.traceFrame(view, true);
+            glFinish();
+            SampleBatch batch(options.samplesPerPass, options.frameTime);
+            auto start = std::chrono::steady_clock::now();
+            traceSamples(renderer, view, options.samples, batch);
+            glFinish();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  " << std::left << std::setw(12) << tracer.name << std::setw(14) << (specialize ? "scene" : "uber") << std::right
+                << std::setw(12) << std::fixed << std::setprecision(1) << compileMs << std::setw(12) << library.binaryBytes() / 1024.0
+                << std::setw(14) << std::setprecision(3) << paths / seconds / 1e6 << std::defaultfloat << std::endl;
+        }
+    }
+    return 0;
+}
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, renderedTexture);
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        
+// Equal time comparison of uniform and adaptive sampling with options.tracer: renders
+// options.samples per pixel uniformly, then samples adaptively for as long as that
+// took, and prints the RMSE of both against the --compare reference.
+int benchmarkAdaptive(const RenderOptions& options) {
+    unsigned int referenceWidth, referenceHeight;
+    std::vector<unsigned char> reference;
+    if (options.compare.empty() || !readPPM(options.compare, referenceWidth, referenceHeight, reference) ||
+        referenceWidth != options.width || referenceHeight != options.height) {
+        std::cout << "ERROR::BENCH_ADAPTIVE::--compare needs a " << options.width << "x" << options.height << " reference PPM" << std::endl;
+        return -1;
+    }
+    if (options.tracer != TracerType::Fragment && options.tracer != TracerType::Compute) {
+        std::cout << "ERROR::BENCH_ADAPTIVE::Only the fragment and compute tracers sample adaptively" << std::endl;
+        return -1;
+    }
+    HeadlessContext context;
+    if (!createHeadlessGL(context)) {
+        return -1;
+    }
+    HeadlessContext workerContext;
+    std::unique_ptr<ShaderCompiler> compiler = createHeadlessCompiler(options, context, workerContext);
+    ShaderLibrary library(compiler.get(), !options.uberShader, options.maxBounce, options.nextEvent);
+    Renderer renderer(options.width, options.height, fov, createScene(options), options.tracer, options.workgroup, &library);
+    renderer.setTileSize(options.tileSize);
+    AdaptiveSampler sampler(options.width, options.height, options.tileSize > 0 ? options.tileSize : adaptiveTileSize, library);
+    glm::mat4 view = camera.GetViewMatrix();
+    renderer.waitUntilReady();
+    sampler.waitUntilReady();
+    //one untimed frame so first-use costs are not measured
+    renderer.traceFrame(view, true);
+    glFinish();
+
+    double pixels = (double)options.width * options.height;
+    std::cout << options.width << "x" << options.height << ", " << options.samplesPerPass << " samples per pass, "
+        << sampler.tileCount() << " tiles of " << sampler.size() << "x" << sampler.size() << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "sampling" << std::right << std::setw(10) << "spp" << std::setw(12) << "seconds"
+        << std::setw(12) << "RMSE" << std::endl;
+    auto printRow = [&](const char* name, double paths, double seconds) {
+        std::cout << "  " << std::left << std::setw(12) << name << std::right << std::setw(10) << paths / pixels << std::setw(12) << seconds
+            << std::setw(12) << imageRMSE(readResolved(renderer), reference) << std::endl;
+    };
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int traced = 0; traced < options.samples;) {
+        unsigned int pass = std::min(options.samplesPerPass, options.samples - traced);
+        renderer.traceFrame(view, traced == 0, pass);
+        traced += pass;
+    }
+    glFinish();
+    double uniformSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printRow("uniform", options.samples * pixels, uniformSeconds);
+
+    //the clock is checked after every pass, which the uniform run did not have to wait for
+    double paths = 0.0;
+    double seconds = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (bool first = true; seconds < uniformSeconds; first = false) {
+        paths += renderer.traceAdaptive(view, first, sampler, options.samplesPerPass);
+        glFinish();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    printRow("adaptive", paths, seconds);
+    return 0;
+}
+
+// Time to a quality target with and without next event estimation: traces with
+// options.tracer until the estimated relative RMSE (TileStatistics) is at most the
+// --tolerance, once per estimator. NEXT_EVENT is compiled in, so each gets its own
+// library and renderer. Each is measured against its own estimate, since the two
+// converge to different images: the original estimator neither weights diffuse
+// bounces by the cosine nor sees the point lights. A --compare reference (rendered
+// with the lights sampled) adds the RMSE against it, which shows that difference.
+int benchmarkNextEvent(const RenderOptions& options) {
+    unsigned int referenceWidth = 0, referenceHeight = 0;
+    std::vector<unsigned char> reference;
+    if (!options.compare.empty() && (!readPPM(options.compare, referenceWidth, referenceHeight, reference) ||
+        referenceWidth != options.width || referenceHeight != options.height)) {
+        std::cout << "ERROR::BENCH_NEE::--compare needs a " << options.width << "x" << options.height << " reference PPM" << std::endl;
+        return -1;
+    }
+    HeadlessContext context;
+    if (!createHeadlessGL(context)) {
+        return -1;
+    }
+    HeadlessContext workerContext;
+    std::unique_ptr<ShaderCompiler> compiler = createHeadlessCompiler(options, context, workerContext);
+    RenderOptions target = options;
+    if (target.tolerance <= 0.0) {
+        target.tolerance = benchNextEventTolerance;
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteFramebuffers(1, &frameBuffer);
+    Scene scene = createScene(options);
+    glm::mat4 view = camera.GetViewMatrix();
+    const char* tracerName = std::find_if(std::begin(gpuTracers), std::end(gpuTracers),
+        [&](const GpuTracerName& tracer) { return tracer.type == options.tracer; })->name;
+    std::cout << options.width << "x" << options.height << ", " << tracerName << " tracer, " << scene.lights.size()
+        << " point light(s) and the sky, tolerance " << target.tolerance << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "estimator" << std::right << std::setw(10) << "spp" << std::setw(12) << "seconds"
+        << std::setw(12) << "error" << std::setw(14) << "Mpaths/sec" << (reference.empty() ? "" : "        RMSE") << std::endl;
+    for (bool nextEvent : { false, true }) {
+        ShaderLibrary library(compiler.get(), !options.uberShader, options.maxBounce, nextEvent);
+        Renderer renderer(options.width, options.height, fov, scene, options.tracer, options.workgroup, &library);
+        renderer.setTileSize(options.tileSize);
+        renderer.setPersistentGroups(options.persistentGroups);
+        TileStatistics statistics(options.width, options.height, adaptiveTileSize, library);
+        renderer.waitUntilReady();
+        statistics.waitUntilReady();
+        glFinish();
+
+        SampleBatch batch(options.samplesPerPass, options.frameTime);
+        auto start = std::chrono::steady_clock::now();
+        StopResult stop = traceUntilStopped(renderer, view, target, batch, nullptr, statistics);
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << std::left << std::setw(12) << (nextEvent ? "nee" : "no nee") << std::right << std::setw(10) << stop.samples
+            << std::setw(12) << seconds << std::setw(12) << stop.error << std::setw(14)
+            << (double)stop.samples * options.width * options.height / seconds / 1e6;
+        if (!reference.empty()) {
+            std::cout << std::setw(12) << imageRMSE(readResolved(renderer), reference);
+        }
+        std::cout << (stop.converged ? "" : "  (time budget used up)") << std::endl;
+    }
+    return 0;
+}
 
-    glfwTerminate();
+bool renderCpu(const RenderOptions& options, std::vector<unsigned char>& pixels) {
+    CpuTracer tracer(createScene(options), options.width, options.height, fov, options.threads, options.simd, options.pinning);
+    bool packets = !options.wavefront && tracer.setPacketsEnabled(options.packets);
+    if (options.packets && !options.wavefront && !packets) {
+        std::cout << "Ray packets need AVX2, tracing single rays" << std::endl;
+    }
+    tracer.setWavefrontEnabled(options.wavefront);
+    tracer.setNextEventEnabled(options.nextEvent);
+    std::cout << "Renderer: CPU reference tracer | " << tracer.threadCount() << " threads on " << tracer.numaNodes() << " NUMA node(s) | "
+        << simdLevelName(tracer.simdLevel()) << (packets ? " packets" : "");
+    if (options.wavefront) {
+        std::cout << " wavefront (" << tracer.pathsPerWave() << " paths per wave)";
+    }
+    std::cout << std::endl;
+    tracer.setView(camera.GetViewMatrix());
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int sample = 0; sample < options.samples; sample++) {
+        tracer.traceFrame();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printThroughput(options, options.samples, seconds);
+    printWorkerStats(tracer.workerStats(), options.workerStats);
+
+    pixels = tracer.resolve();
+    return true;
+}
+
+int runHeadless(const RenderOptions& options) {
+    std::vector<unsigned char> pixels;
+    bool rendered = options.renderer == RendererType::CPU ? renderCpu(options, pixels) : renderGpu(options, pixels);
+    if (!rendered) {
+        return -1;
+    }
+    if (!writePPM(options.output, options.width, options.height, pixels)) {
+        std::cout << "ERROR::HEADLESS::Failed to write " << options.output << std::endl;
+        return -1;
+    }
+    std::cout << "Wrote " << options.output << std::endl;
+
+    if (!options.compare.empty()) {
+        unsigned int referenceWidth, referenceHeight;
+        std::vector<unsigned char> reference;
+        if (!readPPM(options.compare, referenceWidth, referenceHeight, reference) ||
+            referenceWidth != options.width || referenceHeight != options.height) {
+            std::cout << "ERROR::HEADLESS::" << options.compare << " is not a " << options.width << "x" << options.height << " PPM" << std::endl;
+            return -1;
+        }
+        std::cout << "RMSE against " << options.compare << ": " << imageRMSE(pixels, reference) << std::endl;
+    }
     return 0;
 }
 
+void printThroughput(const RenderOptions& options, unsigned int samples, double seconds) {
+    double paths = (double)samples * options.width * options.height;
+    std::cout << samples << " samples in " << seconds << " s: "
+        << samples / seconds << " samples/sec, " << paths / seconds / 1e6 << " Mpaths/sec" << std::endl;
+}
+
+void printWorkerStats(const std::vector<WorkerStats>& stats, bool perThread) {
+    double minUtilization = 1.0, totalUtilization = 0.0;
+    unsigned long long tasks = 0, stolen = 0, crossNodeStolen = 0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        minUtilization = std::min(minUtilization, stats[i].utilization());
+        totalUtilization += stats[i].utilization();
+        tasks += stats[i].tasks;
+        stolen += stats[i].stolen;
+        crossNodeStolen += stats[i].crossNodeStolen;
+        if (perThread) {
+            std::cout << "  thread " << i << ": " << stats[i].tasks << " tiles, " << stats[i].stolen << " stolen ("
+                << stats[i].crossNodeStolen << " cross-node), "
+                << stats[i].failedSteals << " failed steals, " << 100.0 * stats[i].utilization() << "% busy" << std::endl;
+        }
+    }
+    std::cout << "Workers: " << 100.0 * totalUtilization / stats.size() << "% mean / " << 100.0 * minUtilization << "% min utilization, "
+        << stolen << " of " << tasks << " tiles stolen, " << crossNodeStolen << " across NUMA nodes" << std::endl;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -0,0 +1,29 @@
+// Per pixel statistics of the accumulation: the tracers add each sample's color to
+// rgb, 1 to alpha, and its squared luminance to a separate r32f texture.
+
+float Luminance(vec3 color){
+	return dot(color, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Variance of the pixel's mean luminance, i.e. the expected squared error of the
+// pixel; 0 until there are two samples to estimate it from.
+float MeanVariance(vec4 sum, float luminanceSquares){
+	float n = sum.a;
+	if(n < 2.0f){
+		return 0.0f;
+	}
+	float mean = Luminance(sum.rgb) / n;
+	return max(luminanceSquares / n - mean * mean, 0.0f) / (n - 1.0f);
+}
+
+// true once the standard error of the pixel's mean luminance is below threshold
+// times the mean. Needs minSamples first, since the variance of a few samples is
+// no estimate (a pixel whose first paths all missed a light looks converged).
+bool PixelConverged(vec4 sum, float luminanceSquares, float threshold, uint minSamples){
+	if(sum.a < max(float(minSamples), 2.0f)){
+		return false;
+	}
+	float mean = Luminance(sum.rgb) / sum.a;
+	//black pixels are done once they have no variance
+	return sqrt(MeanVariance(sum, luminanceSquares)) <= threshold * max(mean, 1e-3f);
+}
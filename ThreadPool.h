@@ -0,0 +1,229 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WorkStealingDeque.h"
+#include "CpuTopology.h"
+
+// per worker counters, accumulated over every batch since the last resetStats()
+struct WorkerStats {
+	unsigned long long tasks = 0;			//tasks run, including stolen ones
+	unsigned long long stolen = 0;			//tasks taken from another worker's deque
+	unsigned long long crossNodeStolen = 0;	//stolen tasks that came from a worker on another NUMA node
+	unsigned long long failedSteals = 0;	//steal attempts that found an empty or contended deque
+	double busySeconds = 0.0;				//time spent inside tasks
+	double batchSeconds = 0.0;				//wall time of the batches, first task handed out to last task done
+
+	double utilization() const {
+		return batchSeconds > 0.0 ? busySeconds / batchSeconds : 0.0;
+	}
+};
+
+// Fixed set of worker threads that run a batch of indexed tasks at a time.
+// Each batch is split into contiguous runs, one per worker deque; a worker that
+// runs out of its own tasks steals from the others, so uneven tiles (mirror
+// pixels bouncing 50 times next to sky pixels) still keep every core busy.
+// With a pinning policy the workers are bound to cores, each node's workers get
+// one contiguous range of tasks and they steal from their own node first.
+// The calling thread takes part in the batch as worker 0.
+class ThreadPool {
+public:
+	typedef std::function<void(unsigned int task, unsigned int worker)> Task;
+
+	explicit ThreadPool(unsigned int threadCount = 0, PinPolicy policy = PinPolicy::None) {
+		if (threadCount == 0) {
+			threadCount = std::thread::hardware_concurrency();
+		}
+		if (threadCount == 0) {
+			threadCount = 1;
+		}
+		CpuTopology topology = CpuTopology::detect();
+		placement = topology.place(threadCount, policy);
+		nodeCount = policy == PinPolicy::None ? 1 : topology.nodeCount();
+		buildSchedule();
+		deques.reset(new WorkStealingDeque[threadCount]);
+		workerStats.resize(threadCount);
+		if (placement[0].cpu >= 0) {
+			CpuTopology::pinCurrentThread(placement[0].cpu);
+		}
+		for (unsigned int i = 1; i < threadCount; i++) {
+			workers.emplace_back(&ThreadPool::workerLoop, this, i);
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+	}
+
+	unsigned int size() const {
+		return (unsigned int)workers.size() + 1;
+	}
+
+	const std::vector<WorkerStats>& stats() const {
+		return workerStats;
+	}
+
+	unsigned int numaNodes() const {
+		return nodeCount;
+	}
+
+	void resetStats() {
+		std::fill(workerStats.begin(), workerStats.end(), WorkerStats());
+	}
+
+	// Runs task(i, worker) for every i in [0, taskCount) and returns when all are done.
+	// Without stealing every task runs on the worker it was dealt to, which makes the
+	// task to NUMA node mapping deterministic (used for first-touch initialization).
+	void run(unsigned int taskCount, const Task& task, bool steal = true) {
+		unsigned int threadCount = size();
+		//workers are ordered by node, so each node receives one contiguous range of tasks
+		for (unsigned int k = 0; k < threadCount; k++) {
+			unsigned int w = nodeOrder[k];
+			unsigned int begin = (unsigned int)((unsigned long long)taskCount * k / threadCount);
+			unsigned int end = (unsigned int)((unsigned long long)taskCount * (k + 1) / threadCount);
+			deques[w].reset(std::max(end - begin, 1u));
+			//pushed in reverse so the owner pops its run front to back
+			for (unsigned int i = end; i > begin; i--) {
+				deques[w].push(i - 1);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			currentTask = &task;
+			stealing = steal;
+			busyWorkers = (unsigned int)workers.size();
+			batchStart = std::chrono::steady_clock::now();
+			generation++;
+		}
+		wake.notify_all();
+		drain(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return busyWorkers == 0; });
+		currentTask = nullptr;
+		double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+		for (WorkerStats& stats : workerStats) {
+			stats.batchSeconds += batchSeconds;
+		}
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::vector<WorkerPlacement> placement;
+	std::vector<unsigned int> nodeOrder;				//worker indices sorted by node
+	std::vector<std::vector<unsigned int>> victims;		//per worker: same node workers first, then the rest
+	unsigned int nodeCount = 1;
+	std::unique_ptr<WorkStealingDeque[]> deques;
+	std::vector<WorkerStats> workerStats;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const Task* currentTask = nullptr;
+	bool stealing = true;
+	std::chrono::steady_clock::time_point batchStart;
+	unsigned int busyWorkers = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+
+	void execute(unsigned int task, unsigned int worker, WorkerStats& stats) {
+		auto start = std::chrono::steady_clock::now();
+		(*currentTask)(task, worker);
+		stats.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats.tasks++;
+	}
+
+	void buildSchedule() {
+		unsigned int threadCount = (unsigned int)placement.size();
+		for (unsigned int node = 0; node < nodeCount; node++) {
+			for (unsigned int w = 0; w < threadCount; w++) {
+				if (placement[w].node == node) {
+					nodeOrder.push_back(w);
+				}
+			}
+		}
+		victims.resize(threadCount);
+		for (unsigned int w = 0; w < threadCount; w++) {
+			for (int sameNode = 1; sameNode >= 0; sameNode--) {
+				for (unsigned int k = 1; k < threadCount; k++) {
+					unsigned int victim = (w + k) % threadCount;
+					if ((placement[victim].node == placement[w].node) == (sameNode == 1)) {
+						victims[w].push_back(victim);
+					}
+				}
+			}
+		}
+	}
+
+	// walks the other deques, own node first, until a steal succeeds; false once all are empty
+	bool stealOne(unsigned int worker, unsigned int& task, WorkerStats& stats) {
+		bool contended = true;
+		while (contended) {
+			contended = false;
+			for (unsigned int victim : victims[worker]) {
+				WorkStealingDeque::StealResult result = deques[victim].steal(task);
+				if (result == WorkStealingDeque::StealResult::Success) {
+					stats.stolen++;
+					if (placement[victim].node != placement[worker].node) {
+						stats.crossNodeStolen++;
+					}
+					return true;
+				}
+				stats.failedSteals++;
+				contended |= result == WorkStealingDeque::StealResult::Contended;
+			}
+		}
+		return false;
+	}
+
+	void drain(unsigned int worker) {
+		WorkerStats& stats = workerStats[worker];
+		unsigned int task;
+		while (deques[worker].pop(task)) {
+			execute(task, worker, stats);
+		}
+		//no task is added during a batch, so once every deque is empty the batch is done
+		while (stealing && stealOne(worker, task, stats)) {
+			execute(task, worker, stats);
+		}
+	}
+
+	void workerLoop(unsigned int worker) {
+		if (placement[worker].cpu >= 0) {
+			CpuTopology::pinCurrentThread(placement[worker].cpu);
+		}
+		unsigned long long seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) {
+					return;
+				}
+				seen = generation;
+			}
+			drain(worker);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busyWorkers--;
+			}
+			done.notify_one();
+		}
+	}
+};
+
+#endif
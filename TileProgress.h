@@ -0,0 +1,88 @@
+#ifndef TILE_PROGRESS_H
+#define TILE_PROGRESS_H
+
+#include <algorithm>
+#include <vector>
+
+// Samples traced per screen tile for time sliced rendering, where the tracer pass
+// goes over the tiles round robin and only issues as many per frame as fit the
+// frame budget. Tiles traced in the current round are one pass ahead of the
+// others; the view pass divides every pixel by its own count in the
+// accumulation's alpha, so only the caller needs the counts kept here.
+class TileProgress {
+public:
+	struct Tile {
+		unsigned int index;
+		unsigned int x0, y0, x1, y1;		//pixels [x0, x1) x [y0, y1)
+	};
+
+	TileProgress(unsigned int width, unsigned int height, unsigned int tileSize) :
+		width(width),
+		height(height),
+		tileSize(std::max(tileSize, 1u)),
+		tilesX((width + this->tileSize - 1) / this->tileSize),
+		tilesY((height + this->tileSize - 1) / this->tileSize),
+		counts(tilesX * tilesY, 0)
+	{
+	}
+
+	unsigned int size() const {
+		return tileSize;
+	}
+
+	unsigned int tileCount() const {
+		return (unsigned int)counts.size();
+	}
+
+	// the tile the next slice starts with
+	Tile nextTile() const {
+		unsigned int tx = cursor % tilesX;
+		unsigned int ty = cursor / tilesX;
+		return { cursor, tx * tileSize, ty * tileSize, std::min((tx + 1) * tileSize, width), std::min((ty + 1) * tileSize, height) };
+	}
+
+	unsigned int samples(unsigned int tile) const {
+		return counts[tile];
+	}
+
+	// the next tile got samples more paths per pixel; moves on to the one after it
+	void tileTraced(unsigned int samples) {
+		if (counts[cursor] == 0) {
+			untraced--;
+		}
+		counts[cursor] += samples;
+		cursor = (cursor + 1) % tileCount();
+	}
+
+	// every tile got samples more paths per pixel at once, by a pass that cannot be sliced
+	void frameTraced(unsigned int samples) {
+		for (unsigned int& count : counts) {
+			count += samples;
+		}
+		untraced = 0;
+	}
+
+	// the accumulation was dropped (camera move); tiles are traced again from the first
+	void reset() {
+		std::fill(counts.begin(), counts.end(), 0u);
+		cursor = 0;
+		untraced = tileCount();
+	}
+
+	// false while some tile has no samples since the last reset
+	bool complete() const {
+		return untraced == 0;
+	}
+
+private:
+	unsigned int width;
+	unsigned int height;
+	unsigned int tileSize;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	std::vector<unsigned int> counts;		//row major from the bottom row
+	unsigned int cursor = 0;
+	unsigned int untraced = tileCount();
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef TILE_STATISTICS_H
+#define TILE_STATISTICS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "Shader.h"
+#include "ShaderLibrary.h"
+
+// Per tile sums of the accumulation's statistics, reduced on the GPU by
+// TileStatistics.comp so only two floats per tile are read back: the expected
+// squared error of the tile's pixels (the variance of their mean luminance) and
+// their mean luminance. Adaptive sampling compares the tiles' errors; the offline
+// stopping rule adds them up into an error estimate for the whole image.
+class TileStatistics {
+public:
+	struct Tile {
+		unsigned int x0, y0, x1, y1;			//pixels [x0, x1) x [y0, y1)
+	};
+
+	struct Sums {
+		float error;
+		float luminance;
+	};
+
+	TileStatistics(unsigned int width, unsigned int height, unsigned int tileSize, ShaderLibrary& library) :
+		width(width),
+		height(height),
+		tileSize(std::max(tileSize, 1u)),
+		tilesX((width + this->tileSize - 1) / this->tileSize),
+		tilesY((height + this->tileSize - 1) / this->tileSize),
+		shader(library.compute("TileStatistics.comp", "")),
+		sums(tilesX * tilesY, Sums{ 0.0f, 0.0f })
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sums.size() * sizeof(Sums), NULL, GL_DYNAMIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	~TileStatistics() {
+		glDeleteBuffers(1, &buffer);
+	}
+
+	TileStatistics(const TileStatistics&) = delete;
+	TileStatistics& operator=(const TileStatistics&) = delete;
+
+	// blocks until the program is built, so the first read does not have to
+	void waitUntilReady() {
+		shader->waitUntilReady();
+	}
+
+	unsigned int size() const {
+		return tileSize;
+	}
+
+	unsigned int tileCount() const {
+		return (unsigned int)sums.size();
+	}
+
+	Tile tile(unsigned int index) const {
+		unsigned int tx = index % tilesX;
+		unsigned int ty = index / tilesX;
+		return { tx * tileSize, ty * tileSize, std::min((tx + 1) * tileSize, width), std::min((ty + 1) * tileSize, height) };
+	}
+
+	// Sums of every tile of the given accumulation and squared luminance textures.
+	// Waits for the GPU to finish the passes that wrote them.
+	const std::vector<Sums>& read(GLuint accumulation, GLuint squares) {
+		shader->waitUntilReady();
+		shader->use();
+		shader->setUInt("width", width);
+		shader->setUInt("height", height);
+		shader->setUInt("tileSize", tileSize);
+		glBindImageTexture(0, accumulation, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, squares, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+		glDispatchCompute(tilesX, tilesY, 1);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetNamedBufferSubData(buffer, 0, sums.size() * sizeof(Sums), sums.data());
+		return sums;
+	}
+
+	// Estimated RMSE of the image's luminance relative to its mean luminance, from
+	// the latest read. The variance estimates are noisy themselves until every pixel
+	// has a few samples.
+	double relativeError() const {
+		double error = 0.0, luminance = 0.0;
+		for (const Sums& tile : sums) {
+			error += tile.error;
+			luminance += tile.luminance;
+		}
+		double pixels = (double)width * height;
+		return std::sqrt(error / pixels) / std::max(luminance / pixels, 1e-6);
+	}
+
+private:
+	unsigned int width;
+	unsigned int height;
+	unsigned int tileSize;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	std::shared_ptr<Shader> shader;
+	GLuint buffer = 0;
+	std::vector<Sums> sums;					//of the latest read, row major from the bottom row
+};
+
+#endif
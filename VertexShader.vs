@@ -1,8 +1,9 @@
-#version 460 core
+#version 450 core
 layout(location=0) in vec3 recPos;
 
 uniform mat4 proj;
-uniform mat4 c2w;	
+#include "FrameData.glsl"
+
 out vec3 pixelPos;
 
 void main(){
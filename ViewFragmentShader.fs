@@ -1,13 +1,16 @@
-#version 460 core
+#version 450 core
 
 out vec4 FragColor;
 
-uniform sampler2D resultTexture;
-uniform uint count;
+uniform sampler2D resultTexture;	//color sum, sample count in alpha
 uniform uint width;
 uniform uint height;
 
 void main(){
-	vec3 tc = texture(resultTexture, vec2(gl_FragCoord.x / float(width), gl_FragCoord.y / float(height))).rgb;
-	FragColor = vec4(tc / count, 1.0f);
-}
\ No newline at end of file
+	vec4 tc = texture(resultTexture, vec2(gl_FragCoord.x / float(width), gl_FragCoord.y / float(height)));
+	if(tc.a == 0){
+		//not traced yet, whatever is in the target stays
+		discard;
+	}
+	FragColor = vec4(tc.rgb / tc.a, 1.0f);
+}
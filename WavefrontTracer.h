@@ -0,0 +1,296 @@
+#ifndef WAVEFRONT_TRACER_H
+#define WAVEFRONT_TRACER_H
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include "Scene.h"
+#include "CpuPathTracing.h"
+#include "SimdIntersect.h"
+#include "PacketTracer.h"
+
+// Stream version of the CPU tracer. Instead of running each path to completion,
+// a wave of paths goes through one stage at a time:
+//   generate  primary rays for every pixel of the wave
+//   extend    closest hit for every queued ray, 64 rays per AVX2 packet
+//   miss      add the sky color for rays that left the scene
+//   diffuse   shade and scatter all rays that hit a diffuse material, queueing
+//             their light samples when next event estimation is on
+//   metallic  shade and reflect all rays that hit a metallic material
+//   shadow    occlusion tests for light samples queued by the shading stages
+// and the surviving rays are compacted into the next extend queue. Path state is
+// kept in structure-of-arrays buffers sized so one wave fits in half the L2 cache.
+class WavefrontTracer {
+public:
+	// bytes of path state, hit record and queue entries per path, counting one
+	// shadow ray (a single light)
+	static const unsigned int BYTES_PER_PATH = 16 * sizeof(float) + 7 * sizeof(unsigned int) + sizeof(ShadowRay);
+
+	// number of paths per wave for this machine's L2 cache, rounded to whole packets
+	static unsigned int defaultWaveSize() {
+		long l2 = 0;
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+		l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+		if (l2 <= 0) {
+			l2 = 1024 * 1024;
+		}
+		unsigned int paths = (unsigned int)(l2 / 2 / BYTES_PER_PATH);
+		return std::max(RayPacket::SIZE, paths / RayPacket::SIZE * RayPacket::SIZE);
+	}
+
+	WavefrontTracer(const Scene& scene, const SimdIntersector& intersector, unsigned int waveSize) :
+		scene(scene),
+		intersector(intersector),
+		soa(scene),
+		waveSize(waveSize)
+	{
+		usePackets = detectSimdLevel() == SimdLevel::AVX2 && intersector.simdLevel() == SimdLevel::AVX2;
+		for (unsigned int s = 0; s < scene.spheres.size(); s++) {
+			allSpheres.push_back(s);
+		}
+		for (unsigned int p = 0; p < scene.planes.size(); p++) {
+			allPlanes.push_back(p);
+		}
+	}
+
+	unsigned int pathsPerWave() const {
+		return waveSize;
+	}
+
+	// sample the lights at diffuse hits, see tracePath
+	void setNextEventEnabled(bool enabled) {
+		nextEvent = enabled;
+	}
+
+	// Per worker buffers. Allocated once and reused for every wave the worker runs.
+	struct Wave {
+		std::vector<float> ox, oy, oz, dx, dy, dz;
+		std::vector<float> throughputR, throughputG, throughputB;
+		std::vector<float> seedX, seedY;
+		std::vector<float> hitT;
+		std::vector<int> hitPrimitive;
+		std::vector<unsigned int> pixel;
+		std::vector<unsigned int> bounce;
+		//queues hold path indices; a stage only touches the paths in its queue
+		std::vector<unsigned int> extendQueue, nextQueue;
+		std::vector<unsigned int> missQueue, diffuseQueue, metallicQueue;
+		//light samples with the throughput of their path already applied, and their pixels
+		std::vector<ShadowRay> shadowQueue;
+		std::vector<unsigned int> shadowPixel;
+
+		void resize(unsigned int size) {
+			for (std::vector<float>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &throughputR, &throughputG, &throughputB, &seedX, &seedY, &hitT }) {
+				v->resize(size);
+			}
+			hitPrimitive.resize(size);
+			pixel.resize(size);
+			bounce.resize(size);
+			for (std::vector<unsigned int>* q : { &extendQueue, &nextQueue, &missQueue, &diffuseQueue, &metallicQueue, &shadowPixel }) {
+				q->reserve(size);
+			}
+			shadowQueue.reserve(size);
+		}
+	};
+
+	// traces one sample for every pixel in pixels, adding the result to accumulation
+	void traceWave(Wave& wave, const std::vector<unsigned int>& pixels, const PrimaryRayParams& params,
+		const glm::vec2& randomVector, glm::vec3* accumulation) const
+	{
+		if (wave.ox.size() < pixels.size()) {
+			wave.resize(std::max(waveSize, (unsigned int)pixels.size()));
+		}
+		generate(wave, pixels, params, randomVector);
+		while (!wave.extendQueue.empty()) {
+			extend(wave);
+			shadeMiss(wave, accumulation);
+			wave.nextQueue.clear();
+			shadeDiffuse(wave, randomVector);
+			shadeMetallic(wave);
+			traceShadows(wave, accumulation);
+			std::swap(wave.extendQueue, wave.nextQueue);
+		}
+	}
+
+private:
+	const Scene& scene;
+	const SimdIntersector& intersector;
+	SceneSoA soa;
+	unsigned int waveSize;
+	bool usePackets = false;
+	bool nextEvent = false;
+	std::vector<unsigned int> allSpheres;
+	std::vector<unsigned int> allPlanes;
+
+	static Ray loadRay(const Wave& wave, unsigned int i) {
+		Ray ray;
+		ray.pos = glm::vec3(wave.ox[i], wave.oy[i], wave.oz[i]);
+		ray.dir = glm::vec3(wave.dx[i], wave.dy[i], wave.dz[i]);
+		return ray;
+	}
+
+	static void storeRay(Wave& wave, unsigned int i, const Ray& ray) {
+		wave.ox[i] = ray.pos.x; wave.oy[i] = ray.pos.y; wave.oz[i] = ray.pos.z;
+		wave.dx[i] = ray.dir.x; wave.dy[i] = ray.dir.y; wave.dz[i] = ray.dir.z;
+	}
+
+	static ShaderRandom loadRandom(const Wave& wave, unsigned int i, const glm::vec2& randomVector) {
+		return { glm::vec2(wave.seedX[i], wave.seedY[i]), randomVector };
+	}
+
+	static void storeRandom(Wave& wave, unsigned int i, const ShaderRandom& random) {
+		wave.seedX[i] = random.seed.x;
+		wave.seedY[i] = random.seed.y;
+	}
+
+	// position, normal and material of the hit found by extend; only called for queued hits
+	void resolveHit(const Wave& wave, unsigned int i, const Ray& ray, HitInfo& hit) const {
+		ClosestHit closest;
+		closest.t = wave.hitT[i];
+		closest.primitive = wave.hitPrimitive[i];
+		hit.mtl = nullptr;
+		intersector.resolve(ray, closest, hit);
+	}
+
+	void generate(Wave& wave, const std::vector<unsigned int>& pixels, const PrimaryRayParams& params, const glm::vec2& randomVector) const {
+		wave.extendQueue.clear();
+		for (unsigned int i = 0; i < pixels.size(); i++) {
+			unsigned int x = pixels[i] % params.width;
+			unsigned int y = pixels[i] / params.width;
+			glm::vec2 fragCoord(x + 0.5f, y + 0.5f);
+			ShaderRandom random = { fragCoord, randomVector };
+			storeRay(wave, i, generatePrimaryRay(params, params.pixelPos(fragCoord.x, fragCoord.y), random));
+			storeRandom(wave, i, random);
+			wave.throughputR[i] = wave.throughputG[i] = wave.throughputB[i] = 1.0f;
+			wave.pixel[i] = pixels[i];
+			wave.bounce[i] = 0;
+			wave.extendQueue.push_back(i);
+		}
+	}
+
+	void extend(Wave& wave) const {
+		const std::vector<unsigned int>& queue = wave.extendQueue;
+		size_t i = 0;
+#ifdef SIMD_X86
+		if (usePackets) {
+			RayPacket packet;
+			packet.sharedOrigin = false;
+			packet.origin = glm::vec3(0.0f);
+			for (; i + RayPacket::SIZE <= queue.size(); i += RayPacket::SIZE) {
+				for (unsigned int k = 0; k < RayPacket::SIZE; k++) {
+					unsigned int p = queue[i + k];
+					packet.ox[k] = wave.ox[p]; packet.oy[k] = wave.oy[p]; packet.oz[k] = wave.oz[p];
+					packet.dx[k] = wave.dx[p]; packet.dy[k] = wave.dy[p]; packet.dz[k] = wave.dz[p];
+					packet.active[k] = true;
+				}
+				packet.resetHits();
+				intersectPacketSpheresAVX2(soa, allSpheres, packet);
+				intersectPacketPlanesAVX2(soa, allPlanes, packet);
+				for (unsigned int k = 0; k < RayPacket::SIZE; k++) {
+					wave.hitT[queue[i + k]] = packet.t[k];
+					wave.hitPrimitive[queue[i + k]] = (int)packet.primitive[k];
+				}
+			}
+		}
+#endif
+		//the tail that does not fill a packet goes one ray at a time
+		for (; i < queue.size(); i++) {
+			unsigned int p = queue[i];
+			ClosestHit closest = intersector.closestHit(loadRay(wave, p));
+			wave.hitT[p] = closest.t;
+			wave.hitPrimitive[p] = closest.primitive;
+		}
+
+		//sort the queue into per material queues
+		wave.missQueue.clear();
+		wave.diffuseQueue.clear();
+		wave.metallicQueue.clear();
+		for (unsigned int p : queue) {
+			int primitive = wave.hitPrimitive[p];
+			if (primitive < 0) {
+				wave.missQueue.push_back(p);
+				continue;
+			}
+			const Material& mtl = primitive < (int)scene.spheres.size() ?
+				scene.spheres[primitive].mtl : scene.planes[primitive - scene.spheres.size()].mtl;
+			if (mtl.diffuse) {
+				wave.diffuseQueue.push_back(p);
+			}
+			else if (mtl.metallic) {
+				wave.metallicQueue.push_back(p);
+			}
+			//hits on an undefined material end the path black
+		}
+	}
+
+	void shadeMiss(Wave& wave, glm::vec3* accumulation) const {
+		for (unsigned int p : wave.missQueue) {
+			glm::vec3 throughput(wave.throughputR[p], wave.throughputG[p], wave.throughputB[p]);
+			accumulation[wave.pixel[p]] += throughput * skyColor(glm::vec3(wave.dx[p], wave.dy[p], wave.dz[p]));
+		}
+	}
+
+	// multiplies the throughput by the material color and queues the scattered ray if the path has bounces left
+	void continuePath(Wave& wave, unsigned int p, const HitInfo& hit, const Ray& scatter) const {
+		wave.throughputR[p] *= hit.mtl->attenuation.r;
+		wave.throughputG[p] *= hit.mtl->attenuation.g;
+		wave.throughputB[p] *= hit.mtl->attenuation.b;
+		storeRay(wave, p, scatter);
+		if (++wave.bounce[p] < CPU_MAX_BOUNCE) {
+			wave.nextQueue.push_back(p);
+		}
+		//otherwise no light path toward the light source with the given depth
+	}
+
+	void shadeDiffuse(Wave& wave, const glm::vec2& randomVector) const {
+		wave.shadowQueue.clear();
+		wave.shadowPixel.clear();
+		for (unsigned int p : wave.diffuseQueue) {
+			Ray ray = loadRay(wave, p);
+			HitInfo hit;
+			resolveHit(wave, p, ray, hit);
+			ShaderRandom random = loadRandom(wave, p, randomVector);
+			if (nextEvent) {
+				glm::vec3 throughput = glm::vec3(wave.throughputR[p], wave.throughputG[p], wave.throughputB[p]) * hit.mtl->attenuation;
+				lightSamples(scene.lights, hit, [&](ShadowRay shadow) {
+					shadow.light *= throughput;
+					wave.shadowQueue.push_back(shadow);
+					wave.shadowPixel.push_back(wave.pixel[p]);
+				});
+			}
+			Ray scatter;
+			computeScatterRay(hit, ray, random, scatter, nextEvent);
+			storeRandom(wave, p, random);
+			continuePath(wave, p, hit, scatter);
+		}
+	}
+
+	void shadeMetallic(Wave& wave) const {
+		for (unsigned int p : wave.metallicQueue) {
+			Ray ray = loadRay(wave, p);
+			HitInfo hit;
+			resolveHit(wave, p, ray, hit);
+			Ray scatter;
+			scatter.pos = hit.position + 1e-3f * hit.normal;
+			scatter.dir = 2 * glm::dot(-ray.dir, hit.normal) * hit.normal + ray.dir;	//perfect reflection direction
+			continuePath(wave, p, hit, scatter);
+		}
+	}
+
+	// adds the light samples of the diffuse stage that nothing blocks
+	void traceShadows(Wave& wave, glm::vec3* accumulation) const {
+		for (size_t i = 0; i < wave.shadowQueue.size(); i++) {
+			if (!shadowRayBlocked(intersector, wave.shadowQueue[i])) {
+				accumulation[wave.shadowPixel[i]] += wave.shadowQueue[i].light;
+			}
+		}
+	}
+};
+
+#endif
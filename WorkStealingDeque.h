@@ -0,0 +1,73 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Chase-Lev deque of task indices. The owning worker pushes and pops at the bottom,
+// other workers steal from the top without taking a lock. The capacity is fixed per
+// batch because all tiles of a frame are known before the workers start.
+class WorkStealingDeque {
+public:
+	enum class StealResult { Success, Empty, Contended };
+
+	// only call while no worker is using the deque
+	void reset(unsigned int capacity) {
+		if (capacity > bufferCapacity) {
+			buffer.reset(new std::atomic<unsigned int>[capacity]);
+			bufferCapacity = capacity;
+		}
+		top.store(0, std::memory_order_relaxed);
+		bottom.store(0, std::memory_order_relaxed);
+	}
+
+	void push(unsigned int task) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		buffer[b % bufferCapacity].store(task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	bool pop(unsigned int& task) {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		task = buffer[b % bufferCapacity].load(std::memory_order_relaxed);
+		if (t == b) {
+			//last task: race the thieves for it
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	StealResult steal(unsigned int& task) {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b) {
+			return StealResult::Empty;
+		}
+		task = buffer[t % bufferCapacity].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return StealResult::Contended;
+		}
+		return StealResult::Success;
+	}
+
+private:
+	//top and bottom sit on their own cache lines, thieves hammer top while the owner works on bottom
+	alignas(64) std::atomic<int64_t> top{ 0 };
+	alignas(64) std::atomic<int64_t> bottom{ 0 };
+	alignas(64) std::unique_ptr<std::atomic<unsigned int>[]> buffer;
+	unsigned int bufferCapacity = 0;
+};
+
+#endif